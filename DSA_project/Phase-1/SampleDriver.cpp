@@ -18,6 +18,10 @@ Graph G;
 json process_query(const json& query) {
     json result;
     std::string type = query["type"];
+
+    // Optional per-query latency budget; no deadline when absent
+    double budget_ms = query.value("time_budget_ms", -1.0);
+    Deadline deadline = budget_ms > 0 ? Deadline(budget_ms) : Deadline();
     
     try {
         if (type == "remove_edge") {
@@ -46,10 +50,16 @@ json process_query(const json& query) {
                     for (auto x : c["forbidden_road_types"]) forbidR.push_back(x);
             }
             
-            SPResult r = dijkstra(G, src, tgt, mode, forbidN, forbidR);
+            SPResult r = dijkstra(G, src, tgt, mode, forbidN, forbidR, deadline);
             
             result["id"] = query["id"];
-            result["possible"] = r.possible;
+            // a search cut short has not shown that no path exists
+            if (r.timed_out) {
+                result["possible"] = nullptr;
+                result["timed_out"] = true;
+            } else {
+                result["possible"] = r.possible;
+            }
             if (r.possible) {
                 if (mode == "time") 
                     result["minimum_time"] = r.cost;
@@ -62,11 +72,13 @@ json process_query(const json& query) {
             int k = query["k"];
             std::string metric = query["metric"];
             
+            bool timed_out = false;
             std::vector<int> nodes = (metric == "euclidean") ? 
-                knn_euclid(G, query, k) : knn_shortest_path(G, query, k);
+                knn_euclid(G, query, k) : knn_shortest_path(G, query, k, deadline, &timed_out);
             
             result["id"] = query["id"];
             result["nodes"] = nodes;
+            if (timed_out) result["timed_out"] = true;
         }
         
     } catch (const std::exception &e) {
@@ -99,6 +111,7 @@ int main(int argc, char* argv[]) {
     graph_file.close();
 
      G.loadFromJson(graph_json);
+     Deadline::calibrate();
 
     // Read queries from second file
     std::ifstream queries_file(argv[2]);
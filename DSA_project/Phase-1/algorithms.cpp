@@ -42,31 +42,50 @@ double compute_time_with_profile(const Edge &e, double start_time_min) {
 
 
 // --------------------------------------------------
-// Dijkstra: supports "distance" and "time" modes
+// Dijkstra kernel, specialised at compile time on a cost policy and a
+// constraint policy so the relaxation loop carries no mode string compares
+// and no hash lookups when the query has no constraints.
 // --------------------------------------------------
-SPResult dijkstra(const Graph &g, int source, int target, const std::string &mode_in,
-                  const std::vector<int> &forbidden_nodes,
-                  const std::vector<std::string> &forbidden_road_types) {
-    SPResult res{false, 0.0, {}};
+namespace {
 
-    std::unordered_set<int> forbidN(forbidden_nodes.begin(), forbidden_nodes.end());
-    std::unordered_set<std::string> forbidR(forbidden_road_types.begin(), forbidden_road_types.end());
-    if (forbidN.count(source) || forbidN.count(target))
-        return res;
-     if (source == target) {
-       res.possible = true;
-       res.cost = 0.0;             //added source=target case
-       res.path = {source};
-       return res;
-   }
-    // normalize mode
-    std::string mode = mode_in;
-    std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+struct DistanceCost {
+    double operator()(const Edge &e, double) const { return e.length; }
+};
 
-    if (g.nodes.find(source) == g.nodes.end() || 
-    g.nodes.find(target) == g.nodes.end()) {
-    return res;  // Source or target doesn't exist
+struct TimeCost {
+    double operator()(const Edge &e, double d) const {
+        if (!e.speed_profile.empty())
+            return compute_time_with_profile(e, d / 60);   // in seconds
+        return e.average_time;
     }
+};
+
+struct NoConstraint {
+    bool allowed(const Edge &) const { return true; }
+};
+
+struct NodeMask {
+    const std::unordered_set<int> &nodes;
+    bool allowed(const Edge &e) const { return !nodes.count(e.v); }
+};
+
+struct RoadTypeMask {
+    const std::unordered_set<std::string> &roads;
+    bool allowed(const Edge &e) const { return !roads.count(e.road_type); }
+};
+
+struct NodeAndRoadTypeMask {
+    NodeMask n;
+    RoadTypeMask r;
+    bool allowed(const Edge &e) const { return r.allowed(e) && n.allowed(e); }
+};
+
+template <class Cost, class Constraint>
+SPResult dijkstra_kernel(const Graph &g, int source, int target,
+                         const Constraint &constraint, const Deadline &deadline) {
+    SPResult res{false, 0.0, {}};
+    const Cost cost{};
+
     const double INF = std::numeric_limits<double>::infinity();
     std::unordered_map<int, double> dist;
     std::unordered_map<int, int> parent; 
@@ -78,30 +97,25 @@ SPResult dijkstra(const Graph &g, int source, int target, const std::string &mod
     pq.push({0.0, source});
 
     while (!pq.empty()) {
+        if (deadline.expired()) {
+            res.timed_out = true;
+            return res;
+        }
         auto [d, u] = pq.top(); pq.pop();
         if (d > dist[u]) continue;
         if (u == target) break;
-        if (forbidN.count(u)) continue;
-        if (!g.adj.count(u)) continue;
+        auto it = g.adj.find(u);
+        if (it == g.adj.end()) continue;
 
-        for (const auto &e : g.adj.at(u)) {
-            if (forbidR.count(e.road_type) || forbidN.count(e.v)) continue;
-
-            double w;
-            if (mode == "time") {
-                double start_time_min = dist[u]/60;
-                if (!e.speed_profile.empty())
-                    w = compute_time_with_profile(e, start_time_min);//in seconds
-                else
-                    w = e.average_time;
-            } else {
-                w = e.length; // distance mode
-            }
+        for (const auto &e : it->second) {
+            if (!constraint.allowed(e)) continue;
 
-            if (dist[u] + w < dist[e.v]) {
-                dist[e.v] = dist[u] + w;
+            double nd = d + cost(e, d);
+            double &dv = dist[e.v];
+            if (nd < dv) {
+                dv = nd;
                 parent[e.v] = u;
-                pq.push({dist[e.v], e.v});
+                pq.push({nd, e.v});
             }
         }
     }
@@ -123,6 +137,57 @@ SPResult dijkstra(const Graph &g, int source, int target, const std::string &mod
     res.path = path;
     return res;
 }
+
+template <class Cost>
+SPResult dijkstra_constrained(const Graph &g, int source, int target,
+                              const std::unordered_set<int> &forbidN,
+                              const std::unordered_set<std::string> &forbidR,
+                              const Deadline &deadline) {
+    if (forbidN.empty() && forbidR.empty())
+        return dijkstra_kernel<Cost>(g, source, target, NoConstraint{}, deadline);
+    if (forbidR.empty())
+        return dijkstra_kernel<Cost>(g, source, target, NodeMask{forbidN}, deadline);
+    if (forbidN.empty())
+        return dijkstra_kernel<Cost>(g, source, target, RoadTypeMask{forbidR}, deadline);
+    return dijkstra_kernel<Cost>(g, source, target,
+                                 NodeAndRoadTypeMask{{forbidN}, {forbidR}}, deadline);
+}
+
+} // namespace
+
+// --------------------------------------------------
+// Dijkstra: supports "distance" and "time" modes
+// --------------------------------------------------
+SPResult dijkstra(const Graph &g, int source, int target, const std::string &mode_in,
+                  const std::vector<int> &forbidden_nodes,
+                  const std::vector<std::string> &forbidden_road_types,
+                  const Deadline &deadline) {
+    SPResult res{false, 0.0, {}};
+
+    std::unordered_set<int> forbidN(forbidden_nodes.begin(), forbidden_nodes.end());
+    std::unordered_set<std::string> forbidR(forbidden_road_types.begin(), forbidden_road_types.end());
+    if (forbidN.count(source) || forbidN.count(target))
+        return res;
+     if (source == target) {
+       res.possible = true;
+       res.cost = 0.0;             //added source=target case
+       res.path = {source};
+       return res;
+   }
+    // normalize mode
+    std::string mode = mode_in;
+    std::transform(mode.begin(), mode.end(), mode.begin(), ::tolower);
+
+    if (g.nodes.find(source) == g.nodes.end() || 
+    g.nodes.find(target) == g.nodes.end()) {
+    return res;  // Source or target doesn't exist
+    }
+
+    // dispatch once per query to the specialised kernel
+    if (mode == "time")
+        return dijkstra_constrained<TimeCost>(g, source, target, forbidN, forbidR, deadline);
+    return dijkstra_constrained<DistanceCost>(g, source, target, forbidN, forbidR, deadline);
+}
 std::vector<int> knn_euclid(const Graph &g, const json &query, int k) {
     double qlat = query["query_point"]["lat"];
     double qlon = query["query_point"]["lon"];
@@ -144,7 +209,8 @@ std::vector<int> knn_euclid(const Graph &g, const json &query, int k) {
     return out;
 }
 
-std::vector<int> knn_shortest_path(const Graph &g, const json &query, int k) {
+std::vector<int> knn_shortest_path(const Graph &g, const json &query, int k,
+                                   const Deadline &deadline, bool *timed_out) {
     double qlat = query["query_point"]["lat"];
     double qlon = query["query_point"]["lon"];
     //changed type to poi_type in here
@@ -159,9 +225,16 @@ std::vector<int> knn_shortest_path(const Graph &g, const json &query, int k) {
     using P = std::pair<double,int>;
     std::priority_queue<P,std::vector<P>,std::greater<P>> pq;
     pq.push({0.0,start});
+    // only settled labels are final; a search cut short ranks those alone
+    std::unordered_set<int> settled;
     while(!pq.empty()){
+        if (deadline.expired()) {
+            if (timed_out) *timed_out = true;
+            break;
+        }
         auto [d,u]=pq.top(); pq.pop();
         if(d>dist[u])continue;
+        settled.insert(u);
         if (!g.adj.count(u)) continue;
         for(auto &e:g.adj.at(u)){
             if(dist[u]+e.length<dist[e.v]){
@@ -176,7 +249,7 @@ std::vector<int> knn_shortest_path(const Graph &g, const json &query, int k) {
         bool has=false;
         for(auto &p:n.pois)if(p==p_type)has=true;
         if(!has)continue;
-        if(dist[id]<INF)found.push_back({dist[id],id});
+        if(settled.count(id))found.push_back({dist[id],id});
     }
     sort(found.begin(),found.end(),[](auto&a,auto&b){return a.d<b.d;});
     std::vector<int>out;
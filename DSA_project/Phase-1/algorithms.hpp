@@ -1,5 +1,6 @@
 #pragma once
 #include "graph.hpp"
+#include "deadline.hpp"
 #include <vector>
 #include <string>
 #include <optional>
@@ -10,11 +11,16 @@ struct SPResult {
     bool possible;
     double cost;
     std::vector<int> path;
+    bool timed_out = false;   // deadline hit before the target was settled
 };
 
 SPResult dijkstra(const Graph &g, int source, int target, const std::string &mode,
                   const std::vector<int> &forbidden_nodes,
-                  const std::vector<std::string> &forbidden_road_types);
+                  const std::vector<std::string> &forbidden_road_types,
+                  const Deadline &deadline = Deadline::never());
 
 std::vector<int> knn_euclid(const Graph &g, const nlohmann::json &query, int k);
-std::vector<int> knn_shortest_path(const Graph &g, const nlohmann::json &query, int k);
+// On expiry returns the best POIs found so far and sets *timed_out.
+std::vector<int> knn_shortest_path(const Graph &g, const nlohmann::json &query, int k,
+                                   const Deadline &deadline = Deadline::never(),
+                                   bool *timed_out = nullptr);
@@ -0,0 +1,80 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Cooperative deadline token passed to the search routines. expired() is
+// cheap enough to call on every heap pop: it only looks at the clock every
+// CHECK_EVERY calls, and then reads the TSC instead of a system clock where
+// one is available. Copy it per thread; a default-constructed token never
+// expires.
+class Deadline {
+public:
+    static constexpr unsigned CHECK_EVERY = 256;
+
+    Deadline() = default;
+    explicit Deadline(double budget_ms) : finite_(true) {
+        start_ = now_ticks();
+        end_ = start_ + (uint64_t)(budget_ms * ticks_per_ms());
+    }
+
+    static const Deadline &never() {
+        static const Deadline d;
+        return d;
+    }
+
+    // Pays the one-off TSC calibration up front, outside any timed query.
+    static void calibrate() { ticks_per_ms(); }
+
+    bool finite() const { return finite_; }
+
+    // Counted check for hot loops.
+    bool expired() const {
+        if (!finite_) return false;
+        if (hit_) return true;
+        if (++calls_ % CHECK_EVERY != 0) return false;
+        return expired_now();
+    }
+
+    // Reads the clock unconditionally.
+    bool expired_now() const {
+        if (!finite_) return false;
+        if (!hit_ && now_ticks() >= end_) hit_ = true;
+        return hit_;
+    }
+
+    double elapsed_ms() const {
+        return finite_ ? (double)(now_ticks() - start_) / ticks_per_ms() : 0.0;
+    }
+
+private:
+    bool finite_ = false;
+    uint64_t start_ = 0, end_ = 0;
+    mutable unsigned calls_ = 0;
+    mutable bool hit_ = false;
+
+#if defined(__x86_64__) || defined(__i386__)
+    static uint64_t now_ticks() { return __rdtsc(); }
+
+    // Calibrated once per process against steady_clock.
+    static double ticks_per_ms() {
+        static const double rate = [] {
+            auto t0 = std::chrono::steady_clock::now();
+            uint64_t c0 = __rdtsc();
+            while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(2)) {}
+            uint64_t c1 = __rdtsc();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            return (double)(c1 - c0) / ms;
+        }();
+        return rate;
+    }
+#else
+    static uint64_t now_ticks() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    static double ticks_per_ms() { return 1e6; }
+#endif
+};
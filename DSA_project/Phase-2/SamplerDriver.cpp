@@ -3,28 +3,47 @@
 #include <fstream>
 #include <chrono>
 #include <vector>
+#include <algorithm>
 
 // Add your includes
 #include "graph.hpp"
 #include "algorithms.hpp"
 #include "kshortest.hpp"
 #include "approx.hpp"
+#include "landmarks.hpp"
+#include "bench.hpp"
 
 using json = nlohmann::json;
 
-// Global graph object
+// Global graph object and its reversed edges, built once
 Graph G;
+Adjacency RG;
+Landmarks LM;
+
+// Empirical error of the landmark oracle. Pairs the oracle could not
+// certify on its own are sampled during the approx queries and measured
+// against exact Dijkstra distances once the output is written, so the
+// check stays out of the timed queries.
+struct OracleStats {
+    static constexpr size_t SAMPLE = 200;
+    std::vector<std::pair<int,int>> pairs;
+} LM_STATS;
 
 // Process query function for Phase 2
 json process_query(const json& query) {
     json result;
     result["id"] = query["id"];
     std::string type = query["type"];
+
+    // Optional latency budget for the k-shortest queries; approx queries
+    // carry their own time_budget_ms for the whole batch
+    double budget_ms = query.value("time_budget_ms", -1.0);
+    Deadline deadline = budget_ms > 0 ? Deadline(budget_ms) : Deadline();
     
     try {
         if (type == "k_shortest_paths") {
             int k = query["k"];
-            auto paths = yen_k_shortest_paths(G, query["source"], query["target"], k);
+            auto paths = yen_k_shortest_paths(G, query["source"], query["target"], k, deadline);
             
             json arr = json::array();
             if (paths.empty()) {
@@ -35,29 +54,40 @@ json process_query(const json& query) {
                 }
                 result["paths"] = arr;
             }
+            if ((int)paths.size() < k && deadline.expired_now())
+                result["timed_out"] = true;
         }
         else if (type == "k_shortest_paths_heuristic") {
             int k = query["k"];
             double overlap = query["overlap_threshold"];
-            auto paths = heuristic_k_shortest_paths(G, query["source"], query["target"], k, overlap);
+            bool timed_out = false;
+            auto paths = heuristic_k_shortest_paths(G, RG, query["source"], query["target"], k, overlap, deadline,
+                                                    &timed_out);
             
             json arr = json::array();
             for (auto &p : paths) {
                 arr.push_back({{"path", p.path}, {"length", p.length}});
             }
             result["paths"] = arr;
+            if (timed_out) result["timed_out"] = true;
         }
         else if (type == "approx_shortest_path") {
             double time_budget = query["time_budget_ms"];
             double err = query["acceptable_error_pct"];
-            auto res = approx_batch(G, query["queries"], time_budget, err);
+            auto res = approx_batch(G, LM, query["queries"], time_budget, err);
             
             json arr = json::array();
             for (auto &a : res) {
+                // queries the oracle answered alone are within err by construction
+                double up = LM.upper(a.source, a.target);
+                if (LM_STATS.pairs.size() < OracleStats::SAMPLE && a.source != a.target && up < 1e18 &&
+                    up > (1.0 + err / 100.0) * LM.lower(a.source, a.target))
+                    LM_STATS.pairs.push_back({a.source, a.target});
                 arr.push_back({
                     {"source", a.source}, 
                     {"target", a.target}, 
-                    {"approx_shortest_distance", a.approx_shortest_distance}
+                    {"approx_shortest_distance", a.approx_shortest_distance},
+                    {"lower_bound", a.lower_bound}
                 });
             }
             result["distances"] = arr;
@@ -72,6 +102,7 @@ json process_query(const json& query) {
 }
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--bench") return run_bench(argc, argv);
     if (argc != 4) {
         std::cerr << "Usage: " << argv[0] << " <graph.json> <queries.json> <output.json>" << std::endl;
         return 1;
@@ -90,6 +121,17 @@ int main(int argc, char* argv[]) {
     
     // Initialize graph (preprocessing - not timed)
     G.loadFromJson(graph_json);
+    RG = reverse_adjacency(G);
+
+    Deadline::calibrate();
+
+    // Landmark oracle lives next to the graph; rebuild it if missing or stale
+    std::string lm_file = std::string(argv[1]) + ".landmarks";
+    if (!load_landmarks(G, LM, lm_file)) {
+        LM = build_landmarks(G, 16);
+        if (!save_landmarks(G, LM, lm_file))
+            std::cerr << "Warning: could not write " << lm_file << std::endl;
+    }
 
     // Read queries from second file
     std::ifstream queries_file(argv[2]);
@@ -128,5 +170,22 @@ int main(int argc, char* argv[]) {
     output_file << output.dump(4) << std::endl;
 
     output_file.close();
+
+    int measured = 0;
+    double sum_err_pct = 0.0, max_err_pct = 0.0;
+    for (auto [s, t] : LM_STATS.pairs) {
+        SPResult exact = dijkstra(G, s, t);
+        if (!exact.possible || exact.cost <= 0) continue;
+        double est_err = 100.0 * (LM.upper(s, t) - exact.cost) / exact.cost;
+        measured++;
+        sum_err_pct += est_err;
+        max_err_pct = std::max(max_err_pct, est_err);
+    }
+    if (measured > 0) {
+        std::cerr << "Landmark oracle: " << LM.ids.size() << " landmarks, "
+                  << measured << " sampled pairs it could not certify, mean error "
+                  << sum_err_pct / measured << "%, max error "
+                  << max_err_pct << "%" << std::endl;
+    }
     return 0;
 }
\ No newline at end of file
@@ -2,7 +2,7 @@
 #include <queue>
 using namespace std;
 
-SPResult dijkstra(const Graph &g, int source, int target) {
+SPResult dijkstra(const Graph &g, int source, int target, const Deadline &deadline) {
     SPResult res{false, 0.0, {}};
     if (g.nodes.find(source) == g.nodes.end() || g.nodes.find(target) == g.nodes.end())
         return res;
@@ -19,6 +19,10 @@ SPResult dijkstra(const Graph &g, int source, int target) {
     pq.push({0.0, source});
 
     while (!pq.empty()) {
+        if (deadline.expired()) {
+            res.timed_out = true;
+            return res;
+        }
         auto [d,u] = pq.top(); pq.pop();
         if (d > dist[u]) continue;
         if (u == target) break;
@@ -52,3 +56,51 @@ SPResult dijkstra(const Graph &g, int source, int target) {
 
     return res;
 }
+
+Adjacency reverse_adjacency(const Graph &g) {
+    Adjacency radj;
+    for (auto &[u, edges] : g.adj) {
+        for (auto &e : edges) {
+            Edge r = e;
+            swap(r.u, r.v);
+            radj[r.u].push_back(r);
+        }
+    }
+    return radj;
+}
+
+SPTree dijkstra_tree(const Graph &g, const Adjacency &adj, int source, const Deadline &deadline) {
+    SPTree t;
+    if (g.nodes.find(source) == g.nodes.end()) return t;
+
+    t.dist[source] = 0.0;
+    double settled = 0.0;
+
+    using P = pair<double,int>;
+    priority_queue<P, vector<P>, std::greater<P>> pq;
+    pq.push({0.0, source});
+
+    while (!pq.empty()) {
+        if (deadline.expired()) {
+            t.timed_out = true;
+            t.radius = settled;
+            break;
+        }
+        auto [d,u] = pq.top(); pq.pop();
+        if (d > t.dist[u]) continue;
+        settled = d;
+        auto it = adj.find(u);
+        if (it == adj.end()) continue;
+
+        for (auto &e : it->second) {
+            double nd = d + e.length;
+            auto dv = t.dist.find(e.v);
+            if (dv == t.dist.end() || nd < dv->second) {
+                t.dist[e.v] = nd;
+                t.parent[e.v] = u;
+                pq.push({nd, e.v});
+            }
+        }
+    }
+    return t;
+}
@@ -1,12 +1,36 @@
 #pragma once
 #include "graph.hpp"
+#include "deadline.hpp"
 #include <vector>
 #include <unordered_map>
+#include <limits>
 struct SPResult {
     bool possible;
     double cost;
     std::vector<int> path;
+    bool timed_out = false;
 };
 
-SPResult dijkstra(const Graph &g, int source, int target);
+using Adjacency = std::unordered_map<int, std::vector<Edge>>;
+
+// Full shortest-path tree over adj. With g.adj distances are from source;
+// with reverse_adjacency(g) they are *to* source and parent[v] is the next
+// hop from v towards source.
+struct SPTree {
+    std::unordered_map<int, double> dist;
+    std::unordered_map<int, int> parent;
+    bool timed_out = false;
+    // labels up to this are final, and so are their parent chains;
+    // infinity unless the tree timed out
+    double radius = std::numeric_limits<double>::infinity();
+};
+
+// On expiry dijkstra gives up (timed_out) and dijkstra_tree returns the
+// partial tree grown so far, distances not final.
+SPResult dijkstra(const Graph &g, int source, int target,
+                  const Deadline &deadline = Deadline::never());
+SPTree dijkstra_tree(const Graph &g, const Adjacency &adj, int source,
+                     const Deadline &deadline = Deadline::never());
+// Edges reversed; build it once per graph and pass it to the searches.
+Adjacency reverse_adjacency(const Graph &g);
 
@@ -1,135 +1,145 @@
 #include "approx.hpp" 
-#include <chrono>
 #include <queue>
-#include <cmath>
 #include <unordered_set>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 
 using namespace std;
 
-static double heuristic(const Graph &g, int current, int target) {
-    if (g.nodes.find(current) == g.nodes.end() || 
-        g.nodes.find(target) == g.nodes.end()) {
-        return 0.0;
-    }
-    
-    auto &n1 = g.nodes.at(current);
-    auto &n2 = g.nodes.at(target); 
-
-    double dx = n1.lat - n2.lat;
-    double dy = n1.lon - n2.lon;
-
-    return sqrt(dx * dx + dy * dy);
-}
-
-// Weighted A* with epsilon for approximation
-static double weighted_astar(const Graph &g,
-                             int source,
-                             int target,
-                             double epsilon,
-                             chrono::steady_clock::time_point start_all,
-                             double total_time_budget_ms)
+// Bidirectional Dijkstra with a certified stopping rule. mu is the best
+// s-t connection seen so far and top_f + top_b a lower bound on every path
+// not yet seen, so once mu <= (1 + epsilon) * (top_f + top_b) the answer is
+// within epsilon of optimal. lower_bound receives the certified bound.
+static double bidirectional_search(const unordered_map<int, vector<Edge>> &fadj,
+                                   const unordered_map<int, vector<Edge>> &badj,
+                                   int source,
+                                   int target,
+                                   double epsilon,
+                                   const Deadline &deadline,
+                                   double &lower_bound)
 {
     const double INF = 1e18;
-    
-    // Check if nodes exist
-    if (g.nodes.find(source) == g.nodes.end() || 
-        g.nodes.find(target) == g.nodes.end()) {
-        return -1;
-    }
-    
+    lower_bound = 0.0;
+
     // Same node
     if (source == target) {
         return 0.0;
     }
 
-    unordered_map<int, double> g_score;  // Actual distance from source
-    unordered_map<int, double> f_score;  // g + weighted h
-    unordered_set<int> closed;
-    
-    for (auto &[id, node] : g.nodes) {
-        g_score[id] = INF;
-        f_score[id] = INF;
-    }
-    
-    g_score[source] = 0.0;
-    double h_source = heuristic(g, source, target);
-    f_score[source] = (1.0 + epsilon) * h_source;  // Weighted heuristic
+    using State = pair<double, int>;
+    using PQ = priority_queue<State, vector<State>, greater<State>>;
+    unordered_map<int, double> dist[2];
+    PQ pq[2];
+    const unordered_map<int, vector<Edge>> *adj[2] = {&fadj, &badj};
 
-    using State = pair<double, int>;  // (f_score, node)
-    priority_queue<State, vector<State>, greater<State>> pq;
-    pq.push({f_score[source], source});
+    dist[0][source] = 0.0;
+    dist[1][target] = 0.0;
+    pq[0].push({0.0, source});
+    pq[1].push({0.0, target});
+    double mu = INF;
+
+    auto top = [&](int side) {
+        while (!pq[side].empty() && pq[side].top().first > dist[side][pq[side].top().second])
+            pq[side].pop();   // drop stale entries so the bound stays tight
+        return pq[side].empty() ? INF : pq[side].top().first;
+    };
+
+    while (true) {
+        double tf = top(0), tb = top(1);
+        if (tf >= INF || tb >= INF) {   // one side exhausted: mu is exact
+            lower_bound = mu;
+            break;
+        }
+        if (mu <= (1.0 + epsilon) * (tf + tb)) {
+            lower_bound = min(mu, tf + tb);
+            break;
+        }
 
-    while (!pq.empty()) {
         // Check time budget
-        auto now = chrono::steady_clock::now();
-        double elapsed = chrono::duration<double, milli>(now - start_all).count();
-        if (elapsed > total_time_budget_ms * 0.95) {  // Leave 5% margin
+        if (deadline.expired()) {
             return -1;
         }
 
-        auto [f, u] = pq.top();
-        pq.pop();
+        int side = (tf <= tb) ? 0 : 1;
+        auto [d, u] = pq[side].top();
+        pq[side].pop();
 
-        // Skip if already processed
-        if (closed.count(u)) continue;
-        closed.insert(u);
+        auto it = adj[side]->find(u);
+        if (it == adj[side]->end()) continue;
 
-        // Found target
-        if (u == target) {
-            return g_score[u];
+        for (auto &e : it->second) {
+            double nd = d + e.length;
+            auto dv = dist[side].find(e.v);
+            if (dv == dist[side].end() || nd < dv->second) {
+                dist[side][e.v] = nd;
+                pq[side].push({nd, e.v});
+            }
+            auto other = dist[1 - side].find(e.v);
+            if (other != dist[1 - side].end())
+                mu = min(mu, nd + other->second);
         }
+    }
 
-        // Skip if this is an outdated entry
-        if (f > f_score[u]) continue;
+    // No path found
+    return (mu >= INF) ? -1 : mu;
+}
 
-        if (g.adj.find(u) == g.adj.end()) continue;
+// Plain Dijkstra from root over adj that stops as soon as every node in
+// targets is settled. Used for a batch group sharing a source (forward
+// graph) or a target (reverse graph).
+static unordered_map<int, double> group_search(const unordered_map<int, vector<Edge>> &adj,
+                                               int root,
+                                               const unordered_set<int> &targets,
+                                               const Deadline &deadline)
+{
+    unordered_map<int, double> dist, settled;
+    dist[root] = 0.0;
 
-        for (auto &e : g.adj.at(u)) {
-            int v = e.v;
-            
-            // Skip if already closed
-            if (closed.count(v)) continue;
+    using State = pair<double, int>;
+    priority_queue<State, vector<State>, greater<State>> pq;
+    pq.push({0.0, root});
+
+    while (!pq.empty() && settled.size() < targets.size()) {
+        if (deadline.expired()) break;
+
+        auto [d, u] = pq.top();
+        pq.pop();
+        if (d > dist[u]) continue;
+        if (targets.count(u)) settled[u] = d;
 
-            double tentative_g = g_score[u] + e.length;
+        auto it = adj.find(u);
+        if (it == adj.end()) continue;
 
-            if (tentative_g < g_score[v]) {
-                g_score[v] = tentative_g;
-                double h_v = heuristic(g, v, target);
-                f_score[v] = tentative_g + (1.0 + epsilon) * h_v;  // Weighted A*
-                pq.push({f_score[v], v});
+        for (auto &e : it->second) {
+            double nd = d + e.length;
+            auto dv = dist.find(e.v);
+            if (dv == dist.end() || nd < dv->second) {
+                dist[e.v] = nd;
+                pq.push({nd, e.v});
             }
         }
     }
-
-    // No path found
-    return (g_score[target] >= INF) ? -1 : g_score[target];
+    return settled;
 }
 
 vector<ApproxResult> approx_batch(const Graph &g, 
+                                  const Landmarks &lm,
                                   const json &queries, 
                                   double time_budget_ms, 
                                   double error_pct)
 {
     vector<ApproxResult> out;
 
-    auto start_all = chrono::steady_clock::now();
+    // One deadline for the whole batch, leaving a 5% margin
+    Deadline batch_deadline(time_budget_ms * 0.95);
     
-    // Convert error percentage to epsilon for weighted A*
-    // For error_pct = 5, we want paths within 5% of optimal
-    // Weighted A* with weight w = 1 + epsilon guarantees (1+epsilon) approximation
-    // So if we want 5% error, epsilon should be 0.05
+    // For error_pct = 5 the bidirectional search may stop once its answer
+    // is certified within 5% of optimal, so epsilon is 0.05
     double epsilon = error_pct / 100.0;
 
+    vector<ApproxResult> req;
     for (auto &q : queries) {
-        // Check if we've exceeded time budget
-        double elapsed = chrono::duration<double, milli>(
-            chrono::steady_clock::now() - start_all
-        ).count();
-
-        if (elapsed > time_budget_ms) {
-            break;  // Stop processing more queries
-        }
-
         int s = q["source"];
         int t = q["target"];
 
@@ -138,13 +148,127 @@ vector<ApproxResult> approx_batch(const Graph &g,
             g.nodes.find(t) == g.nodes.end()) {
             continue;
         }
+        req.push_back({s, t, -1, 0.0});
+    }
 
-        double approx_dist = weighted_astar(g, s, t, epsilon, start_all, time_budget_ms);
+    // Anytime pass: every query first gets the O(L) landmark answer. Those
+    // already certified within epsilon (or proven unreachable) are done;
+    // the rest are refined by search below, cheapest first.
+    const double INF = 1e18;
+    vector<double> est_cost(req.size(), 0.0);
+    vector<bool> refine(req.size(), true);
+    if (!lm.empty()) {
+        for (int i = 0; i < (int)req.size(); i++) {
+            auto &r = req[i];
+            double lo = lm.lower(r.source, r.target);
+            double up = lm.upper(r.source, r.target);
+            if (lo >= INF) { refine[i] = false; continue; }
+            if (up < INF) {
+                r.approx_shortest_distance = up;
+                r.lower_bound = lo;
+                if (up <= (1.0 + epsilon) * lo) refine[i] = false;
+            }
+            est_cost[i] = lo;
+        }
+    }
 
-        if (approx_dist >= 0) {
-            out.push_back({s, t, approx_dist});
+    // Group by source first; whatever is left is grouped by target, and
+    // queries that share neither run on their own.
+    struct Group { bool by_source; int root; vector<int> members; };
+    vector<Group> groups;
+    vector<bool> grouped(req.size(), false);
+
+    unordered_map<int, vector<int>> by_src, by_tgt;
+    for (int i = 0; i < (int)req.size(); i++) {
+        if (refine[i]) by_src[req[i].source].push_back(i);
+        else grouped[i] = true;
+    }
+    for (int i = 0; i < (int)req.size(); i++) {
+        if (grouped[i]) continue;
+        auto &m = by_src[req[i].source];
+        if (m.size() > 1 && m[0] == i) {
+            groups.push_back({true, req[i].source, m});
+            for (int j : m) grouped[j] = true;
+        }
+    }
+    for (int i = 0; i < (int)req.size(); i++)
+        if (!grouped[i]) by_tgt[req[i].target].push_back(i);
+    for (int i = 0; i < (int)req.size(); i++) {
+        if (grouped[i]) continue;
+        auto &m = by_tgt[req[i].target];
+        if (m.size() > 1 && m[0] == i) {
+            groups.push_back({false, req[i].target, m});
+            for (int j : m) grouped[j] = true;
+        }
+        else if (m.size() == 1) {
+            groups.push_back({true, req[i].source, {i}});
+        }
+    }
+    // A search costs roughly its radius, so a group is as expensive as its
+    // furthest member. Cheap groups go first so one long query can no
+    // longer starve the rest; ties keep the original query order.
+    vector<double> group_cost(groups.size(), 0.0);
+    for (size_t gi = 0; gi < groups.size(); gi++)
+        for (int i : groups[gi].members)
+            group_cost[gi] = max(group_cost[gi], est_cost[i]);
+    vector<size_t> order(groups.size());
+    for (size_t gi = 0; gi < groups.size(); gi++) order[gi] = gi;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (group_cost[a] != group_cost[b]) return group_cost[a] < group_cost[b];
+        return groups[a].members[0] < groups[b].members[0];
+    });
+
+    auto radj = reverse_adjacency(g);
+
+    // Groups are pulled off a shared counter by one worker per core. Each
+    // group owns its members' result slots, so no locking is needed and
+    // whatever finished before the shared deadline is kept.
+    atomic<size_t> next_group{0};
+    auto worker = [&]() {
+        Deadline deadline = batch_deadline;   // per-thread check counter
+        for (size_t oi = next_group++; oi < order.size(); oi = next_group++) {
+            // Check if we've exceeded time budget
+            if (deadline.expired_now()) {
+                break;  // Stop processing more queries
+            }
+
+            auto &gr = groups[order[oi]];
+            if (gr.members.size() == 1) {
+                auto &r = req[gr.members[0]];
+                double lower;
+                double d = bidirectional_search(g.adj, radj, r.source, r.target, epsilon,
+                                                deadline, lower);
+                if (d >= 0) {   // a search cut off by the deadline keeps the estimate
+                    r.approx_shortest_distance = d;
+                    r.lower_bound = lower;
+                }
+                continue;
+            }
+
+            unordered_set<int> targets;
+            for (int i : gr.members)
+                targets.insert(gr.by_source ? req[i].target : req[i].source);
+
+            auto dist = group_search(gr.by_source ? g.adj : radj, gr.root, targets, deadline);
+            for (int i : gr.members) {
+                auto it = dist.find(gr.by_source ? req[i].target : req[i].source);
+                if (it != dist.end())
+                    req[i].approx_shortest_distance = req[i].lower_bound = it->second;
+            }
+        }
+    };
+
+    size_t num_threads = min<size_t>(max(1u, thread::hardware_concurrency()), groups.size());
+    vector<thread> pool;
+    for (size_t i = 1; i < num_threads; i++) pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool) th.join();
+
+    for (auto &r : req) {
+        if (r.approx_shortest_distance >= 0) {
+            out.push_back(r);
         }
     }
     
     return out;
-}
\ No newline at end of file
+}
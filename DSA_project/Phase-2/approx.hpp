@@ -1,9 +1,11 @@
 #pragma once
 #include "algorithms.hpp"
+#include "landmarks.hpp"
 
 struct ApproxResult {
     int source, target;
     double approx_shortest_distance;
+    double lower_bound;   // certified: lower_bound <= exact distance <= approx
 };
 
-std::vector<ApproxResult> approx_batch(const Graph &g, const json &queries, double time_budget_ms, double error_pct);
+std::vector<ApproxResult> approx_batch(const Graph &g, const Landmarks &lm, const json &queries, double time_budget_ms, double error_pct);
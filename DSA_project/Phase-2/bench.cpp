@@ -0,0 +1,145 @@
+#include "bench.hpp"
+#include "kshortest.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_set>
+using namespace std;
+
+// The overlap test the heuristic used before edge_keys: two hash sets
+// built from the raw paths on every call. Kept to time against.
+static double hashed_edge_overlap(const vector<int> &path1, const vector<int> &path2) {
+    if (path1.size() <= 1 || path2.size() <= 1) return 0.0;
+    unordered_set<long long> edges1, edges2;
+    edges1.reserve(path1.size());
+    edges2.reserve(path2.size());
+    auto encode = [](int u, int v) { return ((long long)u << 32) | v; };
+    for (size_t i = 0; i + 1 < path1.size(); ++i)
+        edges1.insert(encode(path1[i], path1[i + 1]));
+    for (size_t i = 0; i + 1 < path2.size(); ++i)
+        edges2.insert(encode(path2[i], path2[i + 1]));
+
+    int common = 0;
+    for (const auto &e : edges1)
+        if (edges2.count(e)) common++;
+    return 100.0 * common / min(edges1.size(), edges2.size());
+}
+
+// Every pair of one query's paths, as the heuristic's filter sees them at
+// k: the old test builds both sets per pair, the new one sorts each
+// path's keys once and merges per pair. Returns the time of each in ms.
+static pair<double, double> time_overlap(const vector<PathResult> &paths, double &checksum_old,
+                                         double &checksum_new) {
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < paths.size(); i++)
+        for (size_t j = 0; j < i; j++)
+            checksum_old += hashed_edge_overlap(paths[j].path, paths[i].path);
+    auto mid = chrono::steady_clock::now();
+    vector<vector<long long>> keys;
+    for (auto &p : paths) keys.push_back(edge_keys(p.path));
+    for (size_t i = 0; i < keys.size(); i++)
+        for (size_t j = 0; j < i; j++)
+            checksum_new += calculate_edge_overlap(keys[j], keys[i]);
+    auto end = chrono::steady_clock::now();
+    return {chrono::duration<double, milli>(mid - start).count(),
+            chrono::duration<double, milli>(end - mid).count()};
+}
+
+// Each pair joins a random node to the farthest node it reaches, so paths
+// are long and every candidate is checked against up to k - 1 long
+// accepted paths. The same pairs run through the heuristic, the
+// penalized-only baseline and Yen; Yen copies the graph per spur node, so
+// it gets YEN_BUDGET_MS per query and reports how often it ran out. The
+// heuristic's paths then time the old and new overlap tests.
+int run_bench(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " --bench <graph.json> [pairs] [k]" << endl;
+        return 1;
+    }
+    int pairs = argc > 3 ? stoi(argv[3]) : 10;
+    int k = argc > 4 ? stoi(argv[4]) : 20;
+    const double OVERLAP = 60.0, YEN_BUDGET_MS = 2000.0;
+
+    ifstream graph_file(argv[2]);
+    if (!graph_file.is_open()) {
+        cerr << "Failed to open " << argv[2] << endl;
+        return 1;
+    }
+    json graph_json;
+    graph_file >> graph_json;
+    Graph g;
+    g.loadFromJson(graph_json);
+    Adjacency radj = reverse_adjacency(g);
+    Deadline::calibrate();
+
+    vector<int> ids;
+    for (auto &[id, _] : g.nodes) ids.push_back(id);
+    sort(ids.begin(), ids.end());
+    mt19937 rng(1);
+    vector<pair<int,int>> queries;
+    double hops = 0.0;
+    for (int tries = 0; (int)queries.size() < pairs && tries < 20 * pairs && !ids.empty(); tries++) {
+        int s = ids[rng() % ids.size()];
+        SPTree t = dijkstra_tree(g, g.adj, s);
+        int far = s;
+        for (auto &[v, d] : t.dist)
+            if (d > t.dist[far] || (d == t.dist[far] && v < far)) far = v;
+        if (far == s) continue;
+        queries.push_back({s, far});
+        for (int cur = far; cur != s; cur = t.parent[cur]) hops++;
+    }
+    if (queries.empty()) {
+        cerr << "No connected pairs in " << argv[2] << endl;
+        return 1;
+    }
+    cout << queries.size() << " pairs, k = " << k << ", mean shortest path " << hops / queries.size()
+         << " edges" << endl;
+
+    auto measure = [&](const string &name, double budget_ms,
+                       const function<vector<PathResult>(int, int, const Deadline &)> &search) {
+        double total_ms = 0.0;
+        long found = 0;
+        int timed_out = 0;
+        for (auto [s, t] : queries) {
+            Deadline deadline = budget_ms > 0 ? Deadline(budget_ms) : Deadline();
+            auto start = chrono::steady_clock::now();
+            auto paths = search(s, t, deadline);
+            total_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+            found += paths.size();
+            if ((int)paths.size() < k && deadline.expired_now()) timed_out++;
+        }
+        cout << name << ": " << total_ms / queries.size() << " ms/query, "
+             << (double)found / queries.size() << " paths/query";
+        if (budget_ms > 0) cout << ", " << timed_out << " hit the " << budget_ms << " ms budget";
+        cout << endl;
+    };
+    vector<vector<PathResult>> path_sets;
+    measure("heuristic (via-node + penalized)", -1.0, [&](int s, int t, const Deadline &d) {
+        path_sets.push_back(heuristic_k_shortest_paths(g, radj, s, t, k, OVERLAP, d));
+        return path_sets.back();
+    });
+    measure("penalized only", -1.0, [&](int s, int t, const Deadline &d) {
+        return penalized_k_shortest_paths(g, s, t, k, OVERLAP, d);
+    });
+    measure("yen", YEN_BUDGET_MS, [&](int s, int t, const Deadline &d) {
+        return yen_k_shortest_paths(g, s, t, k, d);
+    });
+
+    double old_ms = 0.0, new_ms = 0.0, checksum_old = 0.0, checksum_new = 0.0;
+    long comparisons = 0;
+    for (auto &paths : path_sets) {
+        auto [o, n] = time_overlap(paths, checksum_old, checksum_new);
+        old_ms += o;
+        new_ms += n;
+        comparisons += paths.size() * (paths.size() - 1) / 2;
+    }
+    cout << "overlap test on the heuristic's paths, " << comparisons << " comparisons: hash sets "
+         << old_ms << " ms, sorted edge keys " << new_ms << " ms";
+    if (checksum_old != checksum_new) cout << " (results differ)";
+    cout << endl;
+    return 0;
+}
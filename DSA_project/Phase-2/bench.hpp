@@ -0,0 +1,6 @@
+#pragma once
+
+// ./phase2 --bench graph.json [pairs] [k]: times the alternative-route
+// searches on long routes and prints milliseconds per query, then the old
+// and new path overlap tests on the paths found.
+int run_bench(int argc, char* argv[]);
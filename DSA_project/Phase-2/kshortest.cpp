@@ -5,35 +5,38 @@
 #include <algorithm>
 using namespace std;
 
-static double calculate_edge_overlap(const vector<int> &path1, const vector<int> &path2) {
-    if (path1.size() <= 1 || path2.size() <= 1) return 0.0;
-    unordered_set<long long> edges1, edges2;
-    edges1.reserve(path1.size());
-    edges2.reserve(path2.size());
-
-    auto encode = [](int u, int v){
-        return ( (long long)u << 32 ) | v; //combining 2 ints into single 64bit no.
-    };               //t store edges in  hash set easily
-
-    for (size_t i = 0; i + 1 < path1.size(); ++i)
-        edges1.insert(encode(path1[i], path1[i + 1]));
-    for (size_t i = 0; i + 1 < path2.size(); ++i)
-        edges2.insert(encode(path2[i], path2[i + 1]));
-
-    int common = 0;
-    for (const auto &e : edges1)
-        if (edges2.count(e)) common++;
+// Paths are compared as sorted arrays of encoded (u, v) edges, so each
+// overlap test is a single merge instead of building two hash sets.
+vector<long long> edge_keys(const vector<int> &path) {
+    vector<long long> keys;
+    if (path.size() <= 1) return keys;
+    keys.reserve(path.size() - 1);
+    for (size_t i = 0; i + 1 < path.size(); ++i)
+        keys.push_back(((long long)path[i] << 32) | (unsigned int)path[i + 1]);
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    return keys;
+}
 
+double calculate_edge_overlap(const vector<long long> &edges1, const vector<long long> &edges2) {
     size_t total_edges = min(edges1.size(), edges2.size());
     if (total_edges == 0) return 0.0;
 
+    int common = 0;
+    auto a = edges1.begin(), b = edges2.begin();
+    while (a != edges1.end() && b != edges2.end()) {
+        if (*a < *b) ++a;
+        else if (*b < *a) ++b;
+        else { ++common; ++a; ++b; }
+    }
+
     return 100.0 * common / total_edges;
 }
 
-vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k) {
+vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k, const Deadline &deadline) {
     vector<PathResult> A;
 
-    auto first = dijkstra(g, src, tgt);
+    auto first = dijkstra(g, src, tgt, deadline);
     if (!first.possible)
         return {};
 
@@ -89,7 +92,9 @@ vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k)
                 }
             }
 
-            auto spur_res = dijkstra(g_copy, spur, tgt);
+            auto spur_res = dijkstra(g_copy, spur, tgt, deadline);
+            if (spur_res.timed_out)
+                return A;   // degrade to the paths already proven shortest
             if (!spur_res.possible)
                 continue;
 
@@ -119,31 +124,131 @@ vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k)
     return A;
 }
 
-vector<PathResult> heuristic_k_shortest_paths(const Graph &g, int src, int tgt, int k, double overlap_threshold) {
-    vector<PathResult> results;
+// Via-node alternatives: every node v reachable both ways gives the
+// candidate path s -> v -> t out of the forward tree and one backward tree.
+// Tree edges shared by both trees form plateaus; all via nodes on a plateau
+// yield the same path, so each plateau is tried once. Candidates with a
+// long plateau relative to their detour are locally optimal and tried first.
+// Returns false if the deadline cut it short, keeping what was accepted.
+static bool via_node_alternatives(const Graph &g, const Adjacency &radj, SPTree &fwd,
+                                  int src, int tgt, int k,
+                                  double overlap_threshold,
+                                  vector<PathResult> &results,
+                                  const Deadline &deadline) {
+    SPTree bwd = dijkstra_tree(g, radj, tgt, deadline);
+    if (bwd.timed_out) return false;   // partial backward labels give wrong candidates
+    double best = fwd.dist[tgt];
+
+    // plateau edge u->v: v hangs off u in the forward tree and u hangs off v
+    // in the backward tree
+    unordered_map<int, int> plat_prev;
+    for (auto &[v, u] : fwd.parent) {
+        auto it = bwd.parent.find(u);
+        if (it != bwd.parent.end() && it->second == v)
+            plat_prev[v] = u;
+    }
 
-    auto base = dijkstra(g, src, tgt);
-    if (!base.possible)
-        return {};
+    unordered_map<int, int> root_of;
+    auto plateau_root = [&](int v) {
+        vector<int> chain;
+        int cur = v;
+        while (!root_of.count(cur) && plat_prev.count(cur)) {
+            chain.push_back(cur);
+            cur = plat_prev[cur];
+        }
+        int root = root_of.count(cur) ? root_of[cur] : cur;
+        root_of[cur] = root;
+        for (int x : chain) root_of[x] = root;
+        return root;
+    };
+
+    struct Via { int node; double length; double plateau; };
+    unordered_map<int, Via> by_plateau;
+    for (auto &[v, df] : fwd.dist) {
+        if (deadline.expired()) return false;
+        auto it = bwd.dist.find(v);
+        if (it == bwd.dist.end()) continue;
+        int root = plateau_root(v);
+        double plateau = df - fwd.dist[root];
+        auto &slot = by_plateau.try_emplace(root, Via{v, df + it->second, 0.0}).first->second;
+        if (plateau > slot.plateau) slot = {v, df + it->second, plateau};
+    }
 
-    results.push_back({base.path, base.cost});
+    vector<Via> admissible, rest;
+    for (auto &[root, via] : by_plateau) {
+        if (via.length <= best + 1e-9) continue;   // the shortest path itself
+        (via.plateau >= 0.5 * (via.length - best) ? admissible : rest).push_back(via);
+    }
+    auto by_length = [](const Via &a, const Via &b){ return a.length < b.length; };
+    sort(admissible.begin(), admissible.end(), by_length);
+    sort(rest.begin(), rest.end(), by_length);
+    admissible.insert(admissible.end(), rest.begin(), rest.end());
+
+    vector<vector<long long>> accepted;
+    for (auto &r : results) accepted.push_back(edge_keys(r.path));
+
+    for (auto &via : admissible) {
+        if ((int)results.size() >= k) break;
+        if (deadline.expired_now()) return false;
+
+        vector<int> path;
+        for (int cur = via.node; cur != src; cur = fwd.parent[cur])
+            path.push_back(cur);
+        path.push_back(src);
+        reverse(path.begin(), path.end());
+        for (int cur = via.node; cur != tgt; ) {
+            cur = bwd.parent[cur];
+            path.push_back(cur);
+        }
+
+        unordered_set<int> seen(path.begin(), path.end());
+        if (seen.size() != path.size()) continue;   // s->v and v->t cross
 
+        auto keys = edge_keys(path);
+        bool acceptable = true;
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (results[i].path == path ||
+                calculate_edge_overlap(accepted[i], keys) > overlap_threshold) {
+                acceptable = false;
+                break;
+            }
+        }
+        if (acceptable) {
+            results.push_back({path, via.length});
+            accepted.push_back(move(keys));
+        }
+    }
+    return true;
+}
+
+// Fallback for whatever the via-node pass could not fill: repeatedly
+// penalize used edges and re-run Dijkstra. Returns false if the deadline
+// cut it short.
+static bool penalized_alternatives(const Graph &g, int src, int tgt, int k,
+                                   double overlap_threshold,
+                                   vector<PathResult> &results,
+                                   const Deadline &deadline) {
     unordered_map<int, int> edge_usage;
+    vector<vector<long long>> accepted;
 
-    for (size_t i = 0; i + 1 < base.path.size(); ++i) {
-        int u = base.path[i];
-        int v = base.path[i + 1];
-        if (g.adj.find(u) != g.adj.end()) {
-            for (auto &e : g.adj.find(u)->second) {
-                if (e.v == v) {
-                    edge_usage[e.id]++;
-                    break;
+    for (auto &r : results) {
+        accepted.push_back(edge_keys(r.path));
+        for (size_t i = 0; i + 1 < r.path.size(); ++i) {
+            int u = r.path[i];
+            int v = r.path[i + 1];
+            if (g.adj.find(u) != g.adj.end()) {
+                for (auto &e : g.adj.find(u)->second) {
+                    if (e.v == v) {
+                        edge_usage[e.id]++;
+                        break;
+                    }
                 }
             }
         }
     }
 
-    for (int ki = 1; ki < k; ++ki) {
+    for (int ki = (int)results.size(); ki < k; ++ki) {
+        if (deadline.expired_now()) return false;
         Graph mod = g;
 
         for (auto &[id, e] : mod.edge_by_id) {
@@ -161,12 +266,14 @@ vector<PathResult> heuristic_k_shortest_paths(const Graph &g, int src, int tgt,
             }
         }
 
-        auto res = dijkstra(mod, src, tgt);
+        auto res = dijkstra(mod, src, tgt, deadline);
+        if (res.timed_out) return false;
         if (!res.possible) break;
 
+        auto keys = edge_keys(res.path);
         bool acceptable = true;
-        for (auto &prev : results) {
-            double overlap = calculate_edge_overlap(prev.path, res.path);
+        for (auto &prev : accepted) {
+            double overlap = calculate_edge_overlap(prev, keys);
             if (overlap > overlap_threshold) {
                 acceptable = false;
                 break;
@@ -199,6 +306,7 @@ vector<PathResult> heuristic_k_shortest_paths(const Graph &g, int src, int tgt,
         if (is_duplicate) continue;
 
         results.push_back({res.path, res.cost});
+        accepted.push_back(move(keys));
 
         for (size_t i = 0; i + 1 < res.path.size(); i++) {
             int u = res.path[i];
@@ -213,6 +321,51 @@ vector<PathResult> heuristic_k_shortest_paths(const Graph &g, int src, int tgt,
             }
         }
     }
+    return true;
+}
+
+vector<PathResult> heuristic_k_shortest_paths(const Graph &g, const Adjacency &radj, int src, int tgt, int k,
+                                              double overlap_threshold, const Deadline &deadline,
+                                              bool *timed_out) {
+    vector<PathResult> results;
+    bool finished = true;
+
+    // the forward tree gives the shortest path and the via-node pass's s -> v halves
+    SPTree fwd = dijkstra_tree(g, g.adj, src, deadline);
+    auto at_tgt = fwd.dist.find(tgt);
+    if (at_tgt == fwd.dist.end() || at_tgt->second > fwd.radius) {
+        if (timed_out) *timed_out = fwd.timed_out;
+        return {};
+    }
+
+    vector<int> base;
+    for (int cur = tgt; cur != src; cur = fwd.parent[cur])
+        base.push_back(cur);
+    base.push_back(src);
+    reverse(base.begin(), base.end());
+    results.push_back({base, fwd.dist[tgt]});
+
+    // a cut-short forward tree still settled the target: keep just that path
+    if (fwd.timed_out)
+        finished = false;
+    else
+        finished = via_node_alternatives(g, radj, fwd, src, tgt, k, overlap_threshold, results, deadline);
+    if (finished && (int)results.size() < k)
+        finished = penalized_alternatives(g, src, tgt, k, overlap_threshold, results, deadline);
+
+    if (timed_out) *timed_out = !finished;
+    return results;
+}
+
+vector<PathResult> penalized_k_shortest_paths(const Graph &g, int src, int tgt, int k, double overlap_threshold,
+                                              const Deadline &deadline) {
+    vector<PathResult> results;
+
+    auto base = dijkstra(g, src, tgt, deadline);
+    if (!base.possible)
+        return {};
 
+    results.push_back({base.path, base.cost});
+    penalized_alternatives(g, src, tgt, k, overlap_threshold, results, deadline);
     return results;
-}
\ No newline at end of file
+}
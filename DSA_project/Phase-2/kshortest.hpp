@@ -6,5 +6,22 @@ struct PathResult {
     double length;
 };
 
-std::vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k);
-std::vector<PathResult> heuristic_k_shortest_paths(const Graph &g, int src, int tgt, int k, double overlap_threshold);
\ No newline at end of file
+// All return fewer than k paths if the deadline expires first.
+std::vector<PathResult> yen_k_shortest_paths(const Graph &g, int src, int tgt, int k,
+                                             const Deadline &deadline = Deadline::never());
+// radj is reverse_adjacency(g). On expiry returns the paths accepted so
+// far, at least the shortest one once it is settled, and sets *timed_out.
+std::vector<PathResult> heuristic_k_shortest_paths(const Graph &g, const Adjacency &radj, int src, int tgt, int k,
+                                                   double overlap_threshold,
+                                                   const Deadline &deadline = Deadline::never(),
+                                                   bool *timed_out = nullptr);
+// The heuristic without its via-node pass: only penalized re-runs of
+// Dijkstra. Kept as the baseline for the benchmark.
+std::vector<PathResult> penalized_k_shortest_paths(const Graph &g, int src, int tgt, int k,
+                                                   double overlap_threshold,
+                                                   const Deadline &deadline = Deadline::never());
+
+// A path as sorted, de-duplicated (u, v) edge keys, and the share of the
+// shorter key set's edges two such sets have in common, in percent.
+std::vector<long long> edge_keys(const std::vector<int> &path);
+double calculate_edge_overlap(const std::vector<long long> &edges1, const std::vector<long long> &edges2);
\ No newline at end of file
@@ -0,0 +1,164 @@
+#include "landmarks.hpp"
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+using namespace std;
+
+static const double INF = 1e18;
+
+// Farthest-point selection: each new landmark is the node furthest from
+// all landmarks picked so far (ignoring nodes none of them can reach).
+Landmarks build_landmarks(const Graph &g, int count) {
+    Landmarks lm;
+    if (g.nodes.empty() || count <= 0) return lm;
+
+    vector<int> node_ids;
+    for (auto &[id, _] : g.nodes) node_ids.push_back(id);
+    sort(node_ids.begin(), node_ids.end());
+    int n = node_ids.size();
+    count = min(count, n);
+    for (int i = 0; i < n; i++) lm.row[node_ids[i]] = i;
+
+    Adjacency radj = reverse_adjacency(g);
+    vector<SPTree> fwd, bwd;
+    vector<double> closest(n, INF);
+    int next = node_ids[0];
+    for (int l = 0; l < count; l++) {
+        lm.ids.push_back(next);
+        fwd.push_back(dijkstra_tree(g, g.adj, next));
+        bwd.push_back(dijkstra_tree(g, radj, next));
+
+        int best = -1;
+        double best_d = -1.0;
+        for (int i = 0; i < n; i++) {
+            auto it = fwd.back().dist.find(node_ids[i]);
+            if (it != fwd.back().dist.end()) closest[i] = min(closest[i], it->second);
+            if (closest[i] < INF && closest[i] > best_d) {
+                best_d = closest[i];
+                best = node_ids[i];
+            }
+        }
+        if (best == -1 || best_d <= 0.0) break;
+        next = best;
+    }
+
+    int L = lm.ids.size();
+    lm.from_lm.assign((size_t)n * L, INF);
+    lm.to_lm.assign((size_t)n * L, INF);
+    for (int l = 0; l < L; l++) {
+        for (auto &[v, d] : fwd[l].dist) lm.from_lm[(size_t)lm.row[v] * L + l] = d;
+        for (auto &[v, d] : bwd[l].dist) lm.to_lm[(size_t)lm.row[v] * L + l] = d;
+    }
+    return lm;
+}
+
+// Triangle inequality in both directions:
+// d(s,t) >= d(L,t) - d(L,s) and d(s,t) >= d(s,L) - d(t,L).
+// Returns INF when some landmark proves t unreachable from s.
+double Landmarks::lower(int s, int t) const {
+    if (s == t) return 0.0;
+    auto is = row.find(s), it = row.find(t);
+    if (is == row.end() || it == row.end()) return 0.0;
+    int L = ids.size();
+    const double *fs = &from_lm[(size_t)is->second * L], *ft = &from_lm[(size_t)it->second * L];
+    const double *ts = &to_lm[(size_t)is->second * L], *tt = &to_lm[(size_t)it->second * L];
+
+    double best = 0.0;
+    for (int l = 0; l < L; l++) {
+        if (fs[l] < INF && ft[l] >= INF) return INF;
+        if (tt[l] < INF && ts[l] >= INF) return INF;
+        if (fs[l] < INF && ft[l] < INF) best = max(best, ft[l] - fs[l]);
+        if (ts[l] < INF && tt[l] < INF) best = max(best, ts[l] - tt[l]);
+    }
+    return best;
+}
+
+// Best detour through a landmark: min over L of d(s,L) + d(L,t).
+double Landmarks::upper(int s, int t) const {
+    if (s == t) return 0.0;
+    auto is = row.find(s), it = row.find(t);
+    if (is == row.end() || it == row.end()) return INF;
+    int L = ids.size();
+    const double *ts = &to_lm[(size_t)is->second * L], *ft = &from_lm[(size_t)it->second * L];
+
+    double best = INF;
+    for (int l = 0; l < L; l++)
+        best = min(best, ts[l] + ft[l]);
+    return best;
+}
+
+// FNV-1a over the sorted edge list, enough to tell graphs apart.
+static uint64_t graph_fingerprint(const Graph &g) {
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&](const void *p, size_t n) {
+        const unsigned char *b = (const unsigned char *)p;
+        for (size_t i = 0; i < n; i++) { h ^= b[i]; h *= 1099511628211ULL; }
+    };
+    uint64_t n = g.nodes.size();
+    mix(&n, sizeof(n));
+    vector<int> edge_ids;
+    for (auto &[id, _] : g.edge_by_id) edge_ids.push_back(id);
+    sort(edge_ids.begin(), edge_ids.end());
+    for (int id : edge_ids) {
+        auto &e = g.edge_by_id.at(id);
+        mix(&e.id, sizeof(e.id));
+        mix(&e.u, sizeof(e.u));
+        mix(&e.v, sizeof(e.v));
+        mix(&e.length, sizeof(e.length));
+        mix(&e.oneway, sizeof(e.oneway));
+    }
+    return h;
+}
+
+static const char LANDMARK_MAGIC[8] = {'L', 'M', 'K', 'S', 'v', '1', 0, 0};
+
+bool save_landmarks(const Graph &g, const Landmarks &lm, const string &file) {
+    ofstream out(file, ios::binary);
+    if (!out) return false;
+
+    uint64_t hash = graph_fingerprint(g);
+    int32_t n = lm.row.size(), L = lm.ids.size();
+    vector<int32_t> node_ids(n);
+    for (auto &[id, r] : lm.row) node_ids[r] = id;
+
+    out.write(LANDMARK_MAGIC, sizeof(LANDMARK_MAGIC));
+    out.write((char*)&hash, sizeof(hash));
+    out.write((char*)&n, sizeof(n));
+    out.write((char*)&L, sizeof(L));
+    out.write((char*)lm.ids.data(), L * sizeof(int32_t));
+    out.write((char*)node_ids.data(), n * sizeof(int32_t));
+    out.write((char*)lm.from_lm.data(), (size_t)n * L * sizeof(double));
+    out.write((char*)lm.to_lm.data(), (size_t)n * L * sizeof(double));
+    return (bool)out;
+}
+
+bool load_landmarks(const Graph &g, Landmarks &lm, const string &file) {
+    ifstream fin(file, ios::binary);
+    if (!fin) return false;
+
+    char magic[sizeof(LANDMARK_MAGIC)];
+    uint64_t hash;
+    int32_t n, L;
+    fin.read(magic, sizeof(magic));
+    fin.read((char*)&hash, sizeof(hash));
+    fin.read((char*)&n, sizeof(n));
+    fin.read((char*)&L, sizeof(L));
+    if (!fin || memcmp(magic, LANDMARK_MAGIC, sizeof(magic)) != 0) return false;
+    if (hash != graph_fingerprint(g) || n != (int32_t)g.nodes.size() || L <= 0) return false;
+
+    Landmarks res;
+    vector<int32_t> node_ids(n);
+    res.ids.resize(L);
+    res.from_lm.resize((size_t)n * L);
+    res.to_lm.resize((size_t)n * L);
+    fin.read((char*)res.ids.data(), L * sizeof(int32_t));
+    fin.read((char*)node_ids.data(), n * sizeof(int32_t));
+    fin.read((char*)res.from_lm.data(), (size_t)n * L * sizeof(double));
+    fin.read((char*)res.to_lm.data(), (size_t)n * L * sizeof(double));
+    if (!fin) return false;
+
+    for (int i = 0; i < n; i++) res.row[node_ids[i]] = i;
+    lm = move(res);
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "algorithms.hpp"
+
+// Distances from and to a small set of landmark nodes. Gives O(L) lower
+// and upper bounds on d(s, t) without touching the graph.
+struct Landmarks {
+    std::vector<int> ids;
+    std::unordered_map<int, int> row;   // node id -> row in from_lm/to_lm
+    std::vector<double> from_lm;        // d(landmark, v), row-major by node
+    std::vector<double> to_lm;          // d(v, landmark), row-major by node
+
+    bool empty() const { return ids.empty(); }
+    double lower(int s, int t) const;
+    double upper(int s, int t) const;
+};
+
+Landmarks build_landmarks(const Graph &g, int count);
+
+// Persisted next to the graph file; load fails if the file was built for a
+// different graph (node/edge fingerprint mismatch).
+bool save_landmarks(const Graph &g, const Landmarks &lm, const std::string &file);
+bool load_landmarks(const Graph &g, Landmarks &lm, const std::string &file);
@@ -0,0 +1,314 @@
+#include "alns.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+using namespace std;
+
+static const double INF = 1e18;
+
+namespace {
+
+struct Solution {
+    vector<Route> routes;
+    vector<int> where;              // order -> route, -1 while unassigned
+
+    double latency() const {
+        double c = 0.0;
+        for (auto& r : routes) c += r.cost;
+        return c;
+    }
+    int unassigned() const {
+        return count(where.begin(), where.end(), -1);
+    }
+    // an order that fits nowhere under the constraints costs as much as an
+    // unreachable leg
+    double cost() const {
+        return latency() + ClusterStops::UNREACHABLE * unassigned();
+    }
+};
+
+// Change in route cost from dropping the pickup at i and dropoff at j.
+double removal_delta(const ClusterStops& cs, const Route& r, int i, int j)
+{
+    const vector<int>& s = r.s;
+    int L = s.size();
+    if (j == i + 1) {
+        double shift = j + 1 < L ? cs.leg(s[i - 1], s[j + 1]) - cs.leg(s[i - 1], s[i])
+                                   - cs.leg(s[i], s[j]) - cs.leg(s[j], s[j + 1]) : 0.0;
+        return -r.arrive[j] + shift * r.ahead[j + 1];
+    }
+    double first = cs.leg(s[i - 1], s[i + 1]) - cs.leg(s[i - 1], s[i]) - cs.leg(s[i], s[i + 1]);
+    double delta = first * (r.ahead[i + 1] - r.ahead[j]) - r.arrive[j];
+    if (j + 1 < L) {
+        double second = first + cs.leg(s[j - 1], s[j + 1]) - cs.leg(s[j - 1], s[j]) - cs.leg(s[j], s[j + 1]);
+        delta += second * r.ahead[j + 1];
+    }
+    return delta;
+}
+
+void insert_order(const ClusterStops& cs, Solution& sol, int route, int order, const Insertion& ins)
+{
+    Route& r = sol.routes[route];
+    r.s.insert(r.s.begin() + ins.b + 1, 2 * order + 2);
+    r.s.insert(r.s.begin() + ins.a + 1, 2 * order + 1);
+    r.refresh(cs);
+    sol.where[order] = route;
+}
+
+void remove_orders(const ClusterStops& cs, Solution& sol, const vector<int>& orders)
+{
+    vector<char> gone(sol.where.size(), 0);
+    vector<char> touched(sol.routes.size(), 0);
+    for (int o : orders) {
+        gone[o] = 1;
+        touched[sol.where[o]] = 1;
+        sol.where[o] = -1;
+    }
+    for (int r = 0; r < (int)sol.routes.size(); r++) {
+        if (!touched[r]) continue;
+        auto& s = sol.routes[r].s;
+        s.erase(remove_if(s.begin() + 1, s.end(),
+                          [&](int stop) { return gone[ClusterStops::order_of(stop)]; }), s.end());
+        sol.routes[r].refresh(cs);
+    }
+}
+
+vector<int> assigned_orders(const Solution& sol)
+{
+    vector<int> out;
+    for (int o = 0; o < (int)sol.where.size(); o++)
+        if (sol.where[o] >= 0) out.push_back(o);
+    return out;
+}
+
+vector<int> random_removal(const ClusterStops&, const Solution& sol, int q, mt19937_64& rng)
+{
+    vector<int> pool = assigned_orders(sol);
+    q = min(q, (int)pool.size());
+    for (int i = 0; i < q; i++) {
+        int j = uniform_int_distribution<int>(i, pool.size() - 1)(rng);
+        swap(pool[i], pool[j]);
+    }
+    pool.resize(q);
+    return pool;
+}
+
+// Picks from a list sorted best-first, skewed towards the front.
+int skewed_pick(int size, double power, mt19937_64& rng)
+{
+    double y = uniform_real_distribution<double>(0.0, 1.0)(rng);
+    return min(size - 1, (int)(pow(y, power) * size));
+}
+
+vector<int> worst_removal(const ClusterStops& cs, const Solution& sol, int q, mt19937_64& rng)
+{
+    vector<pair<double,int>> gain;          // (saving, order)
+    for (auto& r : sol.routes) {
+        vector<int> pickup_at(cs.orders(), -1);
+        for (int i = 1; i < (int)r.s.size(); i++) {
+            int o = ClusterStops::order_of(r.s[i]);
+            if (ClusterStops::is_pickup(r.s[i])) pickup_at[o] = i;
+            else gain.push_back({-removal_delta(cs, r, pickup_at[o], i), o});
+        }
+    }
+    sort(gain.begin(), gain.end(), greater<pair<double,int>>());
+    vector<int> out;
+    while ((int)out.size() < q && !gain.empty()) {
+        int k = skewed_pick(gain.size(), 3.0, rng);
+        out.push_back(gain[k].second);
+        gain.erase(gain.begin() + k);
+    }
+    return out;
+}
+
+// Shaw removal: orders whose pickups and dropoffs are close to each other
+// in travel time, grown from a random seed order.
+vector<int> shaw_removal(const ClusterStops& cs, const Solution& sol, int q, mt19937_64& rng)
+{
+    vector<int> pool = assigned_orders(sol);
+    if (pool.empty()) return {};
+    auto related = [&](int a, int b) {
+        int pa = 2 * a + 1, pb = 2 * b + 1;
+        return cs.leg(pa, pb) + cs.leg(pb, pa) + cs.leg(pa + 1, pb + 1) + cs.leg(pb + 1, pa + 1);
+    };
+
+    int seed = uniform_int_distribution<int>(0, pool.size() - 1)(rng);
+    vector<int> out = {pool[seed]};
+    pool.erase(pool.begin() + seed);
+    while ((int)out.size() < q && !pool.empty()) {
+        int ref = out[uniform_int_distribution<int>(0, out.size() - 1)(rng)];
+        sort(pool.begin(), pool.end(), [&](int a, int b) { return related(ref, a) < related(ref, b); });
+        int k = skewed_pick(pool.size(), 6.0, rng);
+        out.push_back(pool[k]);
+        pool.erase(pool.begin() + k);
+    }
+    return out;
+}
+
+// Inserts every pending order. regret == 1 is plain cheapest insertion;
+// otherwise the order that loses most by not getting its best route (over
+// its regret best routes) goes first. Orders that fit nowhere are left out.
+void regret_insertion(const ClusterStops& cs, Solution& sol, vector<int> pending, int regret)
+{
+    int R = sol.routes.size();
+    vector<vector<Insertion>> table(pending.size(), vector<Insertion>(R));
+    for (int u = 0; u < (int)pending.size(); u++)
+        for (int r = 0; r < R; r++)
+            table[u][r] = best_insertion(cs, sol.routes[r], pending[u]);
+
+    vector<double> top(regret);
+    while (!pending.empty()) {
+        int pick = -1, pick_route = -1;
+        double pick_score = -INF, pick_cost = INF;
+        for (int u = 0; u < (int)pending.size(); u++) {
+            fill(top.begin(), top.end(), INF);
+            int best_route = -1;
+            for (int r = 0; r < R; r++) {
+                double c = table[u][r].delta;
+                if (c >= top[regret - 1]) continue;
+                if (c < top[0]) best_route = r;
+                int h = regret - 1;
+                while (h > 0 && top[h - 1] > c) { top[h] = top[h - 1]; h--; }
+                top[h] = c;
+            }
+            if (best_route < 0) continue;
+            double score = 0.0;
+            if (regret == 1) score = -top[0];
+            else
+                for (int h = 1; h < regret; h++)
+                    score += (top[h] < INF ? top[h] : top[0]) - top[0];
+            if (score > pick_score || (score == pick_score && top[0] < pick_cost)) {
+                pick = u;
+                pick_route = best_route;
+                pick_score = score;
+                pick_cost = top[0];
+            }
+        }
+
+        if (pick < 0) break;
+        insert_order(cs, sol, pick_route, pending[pick], table[pick][pick_route]);
+        pending[pick] = pending.back();
+        pending.pop_back();
+        table[pick] = move(table.back());
+        table.pop_back();
+        for (int u = 0; u < (int)pending.size(); u++)
+            table[u][pick_route] = best_insertion(cs, sol.routes[pick_route], pending[u]);
+    }
+}
+
+} // namespace
+
+AlnsResult alns_improve(const ClusterStops& cs, vector<vector<int>> routes,
+                        const AlnsOptions& opts, const Deadline& deadline)
+{
+    int n = cs.orders();
+    mt19937_64 rng(opts.seed);
+
+    Solution cur;
+    cur.where.assign(n, -1);
+    cur.routes.resize(routes.size());
+    for (int r = 0; r < (int)routes.size(); r++) {
+        cur.routes[r].s = move(routes[r]);
+        if (cur.routes[r].s.empty()) cur.routes[r].s = {0};
+        for (int stop : cur.routes[r].s)
+            if (stop != 0) cur.where[ClusterStops::order_of(stop)] = r;
+        cur.routes[r].refresh(cs);
+    }
+    vector<int> missing;
+    for (int o = 0; o < n; o++)
+        if (cur.where[o] < 0) missing.push_back(o);
+    if (!cur.routes.empty()) regret_insertion(cs, cur, missing, 1);
+
+    Solution best = cur;
+    double cur_cost = cur.cost(), best_cost = cur_cost;
+    long it = 0;
+
+    if (n > 0 && !cur.routes.empty()) {
+        // operator weights, adapted every SEGMENT iterations from the
+        // scores their pairs earned
+        const int DESTROY = 3, REPAIR = 3, SEGMENT = 100;
+        const double REACTION = 0.1;
+        const double SCORE_BEST = 33, SCORE_BETTER = 9, SCORE_ACCEPTED = 13;
+        double wd[DESTROY] = {1, 1, 1}, wr[REPAIR] = {1, 1, 1};
+        double sd[DESTROY] = {}, sr[REPAIR] = {};
+        int ud[DESTROY] = {}, ur[REPAIR] = {};
+        auto roulette = [&](const double* w, int count) {
+            double total = 0.0;
+            for (int i = 0; i < count; i++) total += w[i];
+            double x = uniform_real_distribution<double>(0.0, total)(rng);
+            for (int i = 0; i < count; i++) {
+                if (x < w[i]) return i;
+                x -= w[i];
+            }
+            return count - 1;
+        };
+
+        int q_min = min(n, 2);
+        int q_max = min(n, max(q_min, min(60, n * 3 / 10)));
+
+        // a solution 5% worse than the start is accepted half the time at
+        // first; the temperature falls geometrically to a thousandth of that
+        double t_start = max(1e-9, 0.05 * cur.latency() / log(2.0));
+        double t_end = t_start * 1e-3;
+        Deadline budget(opts.budget_ms);
+
+        while (true) {
+            if (opts.max_iterations > 0 ? it >= opts.max_iterations : budget.expired_now()) break;
+            if (deadline.expired_now()) break;
+            double progress = opts.max_iterations > 0 ? (double)it / opts.max_iterations
+                                                      : min(1.0, budget.elapsed_ms() / opts.budget_ms);
+            double temperature = t_start * pow(t_end / t_start, progress);
+
+            int d = roulette(wd, DESTROY), r = roulette(wr, REPAIR);
+            int q = uniform_int_distribution<int>(q_min, q_max)(rng);
+            Solution cand = cur;
+            vector<int> removed = d == 0 ? shaw_removal(cs, cand, q, rng)
+                                : d == 1 ? random_removal(cs, cand, q, rng)
+                                         : worst_removal(cs, cand, q, rng);
+            remove_orders(cs, cand, removed);
+            regret_insertion(cs, cand, removed, r + 1);
+            double cost = cand.cost();
+
+            double score = 0.0;
+            if (cost < best_cost - 1e-9) {
+                score = SCORE_BEST;
+                best = cand;
+                best_cost = cost;
+            } else if (cost < cur_cost - 1e-9) {
+                score = SCORE_BETTER;
+            } else if (cost > cur_cost + 1e-9 &&
+                       uniform_real_distribution<double>(0.0, 1.0)(rng) < exp((cur_cost - cost) / temperature)) {
+                score = SCORE_ACCEPTED;
+            }
+            if (score > 0) {
+                cur = move(cand);
+                cur_cost = cost;
+            }
+            sd[d] += score; ud[d]++;
+            sr[r] += score; ur[r]++;
+
+            if (++it % SEGMENT == 0) {
+                for (int i = 0; i < DESTROY; i++) {
+                    if (ud[i]) wd[i] = (1 - REACTION) * wd[i] + REACTION * sd[i] / ud[i];
+                    wd[i] = max(wd[i], 0.05);
+                    sd[i] = 0; ud[i] = 0;
+                }
+                for (int i = 0; i < REPAIR; i++) {
+                    if (ur[i]) wr[i] = (1 - REACTION) * wr[i] + REACTION * sr[i] / ur[i];
+                    wr[i] = max(wr[i], 0.05);
+                    sr[i] = 0; ur[i] = 0;
+                }
+            }
+        }
+    }
+
+    AlnsResult res;
+    res.iterations = it;
+    res.unassigned = best.unassigned();
+    for (auto& r : best.routes) {
+        improve_route(r.s, cs, deadline);
+        res.cost += route_latency(r.s, cs);
+        res.routes.push_back(move(r.s));
+    }
+    return res;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "routes.hpp"
+#include <cstdint>
+#include <vector>
+
+struct AlnsOptions {
+    double budget_ms = 1000;        // wall-clock budget for the search
+    long max_iterations = 0;        // > 0: stop after this many instead (reproducible per seed)
+    uint64_t seed = 1;
+};
+
+struct AlnsResult {
+    std::vector<std::vector<int>> routes;   // one stop sequence per driver
+    double cost = 0.0;                      // total route_latency
+    int unassigned = 0;                     // orders no route had room for
+    long iterations = 0;
+};
+
+// Adaptive large neighbourhood search over all routes at once: Shaw, random
+// and worst removal; greedy and regret-2/3 insertion; simulated-annealing
+// acceptance. routes holds one stop sequence per driver, each starting at
+// the depot; orders missing from every route are inserted first. Returns
+// the best solution seen, each route polished with improve_route. Under
+// windows or a capacity some orders may be left unassigned; each counts as
+// an unreachable leg in the search.
+AlnsResult alns_improve(const ClusterStops& cs, std::vector<std::vector<int>> routes,
+                        const AlnsOptions& opts, const Deadline& deadline = Deadline::never());
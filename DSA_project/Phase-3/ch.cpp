@@ -0,0 +1,595 @@
+#include "ch.hpp"
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+using namespace std;
+
+static const double INF = 1e18;
+
+namespace {
+
+struct Arc {
+    int to;
+    double w;
+    int mid;
+};
+
+// Node-by-node contraction with lazy priority updates. Priority is the
+// edge difference plus the number of already contracted neighbours, which
+// keeps the hierarchy shallow and the search spaces small.
+struct Builder {
+    int n;
+    vector<vector<Arc>> out, in;
+    vector<char> contracted;
+    vector<int> deleted_neighbors;
+
+    vector<double> wdist;
+    vector<int> wstamp, target_stamp;
+    int stamp = 0;
+    vector<pair<double,int>> heap;
+
+    // witness searches are cut short; a missed witness only costs an
+    // unnecessary shortcut, never a wrong distance
+    static constexpr int MAX_SETTLED_SIMULATE = 50;
+    static constexpr int MAX_SETTLED_CONTRACT = 500;
+
+    explicit Builder(const DenseGraph& dg)
+        : n(dg.size()), out(n), in(n), contracted(n, 0), deleted_neighbors(n, 0),
+          wdist(n, INF), wstamp(n, 0), target_stamp(n, 0)
+    {
+        for (int u = 0; u < n; u++) {
+            for (int k = dg.first[u]; k < dg.first[u + 1]; k++) {
+                int v = dg.head[k];
+                if (v == u) continue;
+                add_arc(u, v, dg.weight[k], -1);
+            }
+        }
+    }
+
+    // Keeps only the cheapest arc between a pair of nodes.
+    void add_arc(int u, int v, double w, int mid) {
+        for (auto& a : out[u]) {
+            if (a.to != v) continue;
+            if (w < a.w) {
+                a.w = w; a.mid = mid;
+                for (auto& b : in[v]) if (b.to == u) { b.w = w; b.mid = mid; }
+            }
+            return;
+        }
+        out[u].push_back({v, w, mid});
+        in[v].push_back({u, w, mid});
+    }
+
+    double dist_of(int v) const { return wstamp[v] == stamp ? wdist[v] : INF; }
+
+    // Bounded Dijkstra from src among uncontracted nodes, never entering skip.
+    // Stops early once all `targets` nodes (marked with target_stamp ==
+    // stamp by the caller) are settled.
+    void witness_search(int src, int skip, double limit, int max_settled, int targets) {
+        auto cmp = greater<pair<double,int>>();
+        heap.clear();
+        wstamp[src] = stamp; wdist[src] = 0.0;
+        heap.push_back({0.0, src});
+        int settled = 0;
+        while (!heap.empty() && settled < max_settled) {
+            pop_heap(heap.begin(), heap.end(), cmp);
+            auto [d, u] = heap.back(); heap.pop_back();
+            if (d > dist_of(u)) continue;
+            if (d > limit) break;
+            if (target_stamp[u] == stamp && --targets == 0) break;
+            settled++;
+            for (auto& a : out[u]) {
+                if (contracted[a.to] || a.to == skip) continue;
+                double nd = d + a.w;
+                if (nd < dist_of(a.to)) {
+                    wstamp[a.to] = stamp; wdist[a.to] = nd;
+                    heap.push_back({nd, a.to});
+                    push_heap(heap.begin(), heap.end(), cmp);
+                }
+            }
+        }
+    }
+
+    // Shortcuts needed to contract v; added to the graph when apply is set.
+    int contract(int v, bool apply) {
+        int shortcuts = 0;
+        double max_out = 0.0;
+        for (auto& b : out[v]) if (!contracted[b.to]) max_out = max(max_out, b.w);
+
+        struct Shortcut { int u, x; double w; };
+        vector<Shortcut> pending;
+        for (auto& a : in[v]) {
+            int u = a.to;
+            if (contracted[u]) continue;
+            ++stamp;
+            int targets = 0;
+            for (auto& b : out[v])
+                if (!contracted[b.to] && b.to != u && target_stamp[b.to] != stamp) {
+                    target_stamp[b.to] = stamp;
+                    targets++;
+                }
+            if (targets == 0) continue;
+            witness_search(u, v, a.w + max_out, apply ? MAX_SETTLED_CONTRACT : MAX_SETTLED_SIMULATE, targets);
+            for (auto& b : out[v]) {
+                int x = b.to;
+                if (contracted[x] || x == u) continue;
+                double via = a.w + b.w;
+                if (dist_of(x) <= via) continue;
+                shortcuts++;
+                if (apply) pending.push_back({u, x, via});
+            }
+        }
+        for (auto& sc : pending) add_arc(sc.u, sc.x, sc.w, v);
+        return shortcuts;
+    }
+
+    // Drops v from its neighbours' lists once it is contracted.
+    void detach(int v) {
+        auto drop = [v](vector<Arc>& arcs) {
+            arcs.erase(remove_if(arcs.begin(), arcs.end(),
+                       [v](const Arc& a) { return a.to == v; }), arcs.end());
+        };
+        for (auto& a : out[v]) drop(in[a.to]);
+        for (auto& a : in[v]) drop(out[a.to]);
+    }
+
+    int priority(int v) {
+        int degree = 0;
+        for (auto& a : out[v]) degree += !contracted[a.to];
+        for (auto& a : in[v]) degree += !contracted[a.to];
+        return contract(v, false) - degree + deleted_neighbors[v];
+    }
+};
+
+} // namespace
+
+CH build_ch(const DenseGraph& dg)
+{
+    Builder b(dg);
+    int n = b.n;
+
+    using Item = pair<int,int>;
+    priority_queue<Item, vector<Item>, greater<Item>> pq;
+    for (int v = 0; v < n; v++) pq.push({b.priority(v), v});
+
+    vector<int> order;   // contraction order, least important first
+    order.reserve(n);
+    // arcs leaving each node towards nodes contracted after it
+    vector<vector<Arc>> up(n), down(n);
+
+    while (!pq.empty()) {
+        auto [p, v] = pq.top(); pq.pop();
+        if (b.contracted[v]) continue;
+        int now = b.priority(v);
+        if (!pq.empty() && now > pq.top().first) {   // lazy update
+            pq.push({now, v});
+            continue;
+        }
+
+        b.contract(v, true);
+        for (auto& a : b.out[v]) if (!b.contracted[a.to]) up[v].push_back(a);
+        for (auto& a : b.in[v]) if (!b.contracted[a.to]) down[v].push_back(a);
+        b.contracted[v] = 1;
+        order.push_back(v);
+
+        for (auto& a : b.out[v]) b.deleted_neighbors[a.to]++;
+        for (auto& a : b.in[v]) b.deleted_neighbors[a.to]++;
+        b.detach(v);
+    }
+
+    CH ch;
+    ch.n = n;
+    ch.node_at.assign(order.rbegin(), order.rend());
+    ch.pos.assign(n, 0);
+    for (int p = 0; p < n; p++) ch.pos[ch.node_at[p]] = p;
+
+    ch.up_first.assign(n + 1, 0);
+    ch.down_first.assign(n + 1, 0);
+    for (int p = 0; p < n; p++) {
+        int v = ch.node_at[p];
+        ch.up_first[p + 1] = ch.up_first[p] + up[v].size();
+        ch.down_first[p + 1] = ch.down_first[p] + down[v].size();
+        for (auto& a : up[v]) {
+            ch.up_head.push_back(ch.pos[a.to]);
+            ch.up_weight.push_back(a.w);
+            ch.up_mid.push_back(a.mid);
+        }
+        for (auto& a : down[v]) {
+            ch.down_tail.push_back(ch.pos[a.to]);
+            ch.down_weight.push_back(a.w);
+            ch.down_mid.push_back(a.mid);
+        }
+    }
+    return ch;
+}
+
+void unpack_arcs(const CH& ch, vector<UnpackArc>& up, vector<UnpackArc>& down)
+{
+    int n = ch.n;
+    up.assign(ch.up_head.size(), {0, -1, -1});
+    down.assign(ch.down_tail.size(), {0, -1, -1});
+
+    // every arc u -> v of the hierarchy, by positions; an arc up from p is
+    // stored under its tail p, one down into p under its head
+    unordered_map<uint64_t, int> up_at, down_at;
+    auto key = [](int u, int v) { return (uint64_t)(uint32_t)u << 32 | (uint32_t)v; };
+    for (int p = 0; p < n; p++) {
+        for (int k = ch.up_first[p]; k < ch.up_first[p + 1]; k++) {
+            up[k].head = ch.up_head[k];
+            up_at[key(p, ch.up_head[k])] = k;
+        }
+        for (int k = ch.down_first[p]; k < ch.down_first[p + 1]; k++) {
+            down[k].head = p;
+            down_at[key(ch.down_tail[k], p)] = k;
+        }
+    }
+
+    // A shortcut u -> v via m replaces u -> m and m -> v, both kept when m
+    // was contracted: m sits past u and v, so the first is a downward arc
+    // and the second an upward one.
+    for (int p = 0; p < n; p++) {
+        for (int k = ch.up_first[p]; k < ch.up_first[p + 1]; k++) {
+            if (ch.up_mid[k] < 0) continue;
+            int m = ch.pos[ch.up_mid[k]];
+            up[k].left = down_at.at(key(p, m));
+            up[k].right = up_at.at(key(m, ch.up_head[k]));
+        }
+        for (int k = ch.down_first[p]; k < ch.down_first[p + 1]; k++) {
+            if (ch.down_mid[k] < 0) continue;
+            int m = ch.pos[ch.down_mid[k]];
+            down[k].left = down_at.at(key(ch.down_tail[k], m));
+            down[k].right = up_at.at(key(m, p));
+        }
+    }
+}
+
+void attach_extras(CH& ch, const DenseGraph& dg, const vector<float>& arc_extra, int width)
+{
+    int n = ch.n;
+    ch.extra_width = width;
+    ch.up_extra.assign(ch.up_head.size() * width, 0.0f);
+    ch.down_extra.assign(ch.down_tail.size() * width, 0.0f);
+    vector<UnpackArc> up, down;
+    unpack_arcs(ch, up, down);
+
+    // A road edge takes the labels of the cheapest parallel arc, the one
+    // the builder kept; a shortcut sums the two arcs it replaces, which
+    // are stored under the middle node's position, past both ends, so
+    // walking positions backwards resolves them first.
+    auto resolve = [&](int u, int v, double w, const UnpackArc& a, float* out) {
+        if (a.left >= 0) {
+            const float* l = &ch.down_extra[(size_t)a.left * width];
+            const float* r = &ch.up_extra[(size_t)a.right * width];
+            for (int c = 0; c < width; c++) out[c] = l[c] + r[c];
+            return;
+        }
+        int best = -1;
+        for (int k = dg.first[u]; k < dg.first[u + 1]; k++)
+            if (dg.head[k] == v && (best < 0 || dg.weight[k] < dg.weight[best])) best = k;
+        if (best >= 0 && dg.weight[best] == w)
+            copy_n(&arc_extra[(size_t)best * width], width, out);
+    };
+    for (int p = n - 1; p >= 0; p--) {
+        int x = ch.node_at[p];
+        for (int k = ch.up_first[p]; k < ch.up_first[p + 1]; k++)
+            resolve(x, ch.node_at[ch.up_head[k]], ch.up_weight[k], up[k], &ch.up_extra[(size_t)k * width]);
+        for (int k = ch.down_first[p]; k < ch.down_first[p + 1]; k++)
+            resolve(ch.node_at[ch.down_tail[k]], x, ch.down_weight[k], down[k],
+                    &ch.down_extra[(size_t)k * width]);
+    }
+}
+
+// phast_rows with side labels: the same searches, but a lane that improves
+// also takes over the labels of the arc's tail, so the sweep can't be
+// branch-free.
+static void phast_with_extras(const CH& ch, const int* sources, int count, double* const* rows,
+                              float* const* extra_rows, PhastWorkspace& ws)
+{
+    const int L = PHAST_LANES;
+    int n = ch.n, W = ch.extra_width;
+    ws.lanes.assign((size_t)n * L, INF);
+    ws.extras.assign((size_t)n * L * W, 0.0f);
+    double* d = ws.lanes.data();
+    float* x = ws.extras.data();
+    auto cmp = greater<pair<double,int>>();
+    auto take = [&](int q, int p, int l, const float* arc) {
+        float* to = x + ((size_t)q * L + l) * W;
+        const float* from = x + ((size_t)p * L + l) * W;
+        for (int c = 0; c < W; c++) to[c] = from[c] + arc[c];
+    };
+
+    for (int l = 0; l < count; l++) {
+        int s = ch.pos[sources[l]];
+        d[(size_t)s * L + l] = 0.0;
+        ws.heap.clear();
+        ws.heap.push_back({0.0, s});
+        while (!ws.heap.empty()) {
+            pop_heap(ws.heap.begin(), ws.heap.end(), cmp);
+            auto [du, p] = ws.heap.back(); ws.heap.pop_back();
+            if (du > d[(size_t)p * L + l]) continue;
+            for (int k = ch.up_first[p]; k < ch.up_first[p + 1]; k++) {
+                int q = ch.up_head[k];
+                double nd = du + ch.up_weight[k];
+                if (nd < d[(size_t)q * L + l]) {
+                    d[(size_t)q * L + l] = nd;
+                    take(q, p, l, &ch.up_extra[(size_t)k * W]);
+                    ws.heap.push_back({nd, q});
+                    push_heap(ws.heap.begin(), ws.heap.end(), cmp);
+                }
+            }
+        }
+    }
+
+    for (int p = 0; p < n; p++) {
+        double* dp = d + (size_t)p * L;
+        for (int k = ch.down_first[p]; k < ch.down_first[p + 1]; k++) {
+            int q = ch.down_tail[k];
+            const double* dq = d + (size_t)q * L;
+            double w = ch.down_weight[k];
+            for (int l = 0; l < count; l++)
+                if (dq[l] + w < dp[l]) {
+                    dp[l] = dq[l] + w;
+                    take(p, q, l, &ch.down_extra[(size_t)k * W]);
+                }
+        }
+    }
+
+    for (int l = 0; l < count; l++)
+        for (int p = 0; p < n; p++) {
+            int v = ch.node_at[p];
+            rows[l][v] = d[(size_t)p * L + l];
+            copy_n(x + ((size_t)p * L + l) * W, W, extra_rows[l] + (size_t)v * W);
+        }
+}
+
+void phast_rows(const CH& ch, const int* sources, int count, double* const* rows, PhastWorkspace& ws,
+                float* const* extra_rows)
+{
+    if (extra_rows && ch.extra_width > 0)
+        return phast_with_extras(ch, sources, count, rows, extra_rows, ws);
+
+    const int L = PHAST_LANES;
+    int n = ch.n;
+    ws.lanes.assign((size_t)n * L, INF);
+    double* d = ws.lanes.data();
+    auto cmp = greater<pair<double,int>>();
+
+    // upward search per source, each in its own lane
+    for (int l = 0; l < count; l++) {
+        int s = ch.pos[sources[l]];
+        d[(size_t)s * L + l] = 0.0;
+        ws.heap.clear();
+        ws.heap.push_back({0.0, s});
+        while (!ws.heap.empty()) {
+            pop_heap(ws.heap.begin(), ws.heap.end(), cmp);
+            auto [du, p] = ws.heap.back(); ws.heap.pop_back();
+            if (du > d[(size_t)p * L + l]) continue;
+            for (int k = ch.up_first[p]; k < ch.up_first[p + 1]; k++) {
+                int q = ch.up_head[k];
+                double nd = du + ch.up_weight[k];
+                if (nd < d[(size_t)q * L + l]) {
+                    d[(size_t)q * L + l] = nd;
+                    ws.heap.push_back({nd, q});
+                    push_heap(ws.heap.begin(), ws.heap.end(), cmp);
+                }
+            }
+        }
+    }
+
+    // downward sweep: all tails of arcs into p are already final
+    for (int p = 0; p < n; p++) {
+        double* dp = d + (size_t)p * L;
+        for (int k = ch.down_first[p]; k < ch.down_first[p + 1]; k++) {
+            const double* dq = d + (size_t)ch.down_tail[k] * L;
+            double w = ch.down_weight[k];
+            for (int l = 0; l < L; l++) {
+                double nd = dq[l] + w;
+                dp[l] = nd < dp[l] ? nd : dp[l];
+            }
+        }
+    }
+
+    for (int l = 0; l < count; l++)
+        for (int p = 0; p < n; p++)
+            rows[l][ch.node_at[p]] = d[(size_t)p * L + l];
+}
+
+namespace {
+
+// Upward Dijkstra from position s over either the up arcs (forward) or the
+// down arcs read backwards; calls visit(position, distance) per settled node.
+// from and via hold the tree: the position and arc a settled node was
+// reached over (-1 at s).
+struct UpwardSearch {
+    vector<double> dist;
+    vector<int> from, via;
+    vector<int> touched;
+    vector<pair<double,int>> heap;
+
+    explicit UpwardSearch(int n) : dist(n, INF), from(n, -1), via(n, -1) {}
+
+    template <class Visit>
+    void run(const CH& ch, int s, bool backward, Visit visit) {
+        const vector<int>& first = backward ? ch.down_first : ch.up_first;
+        const vector<int>& head = backward ? ch.down_tail : ch.up_head;
+        const vector<double>& weight = backward ? ch.down_weight : ch.up_weight;
+        auto cmp = greater<pair<double,int>>();
+
+        for (int p : touched) dist[p] = INF;
+        touched.clear();
+        heap.clear();
+        dist[s] = 0.0;
+        from[s] = via[s] = -1;
+        touched.push_back(s);
+        heap.push_back({0.0, s});
+        while (!heap.empty()) {
+            pop_heap(heap.begin(), heap.end(), cmp);
+            auto [d, p] = heap.back(); heap.pop_back();
+            if (d > dist[p]) continue;
+            visit(p, d);
+            for (int k = first[p]; k < first[p + 1]; k++) {
+                int q = head[k];
+                double nd = d + weight[k];
+                if (nd < dist[q]) {
+                    if (dist[q] == INF) touched.push_back(q);
+                    dist[q] = nd;
+                    from[q] = p;
+                    via[q] = k;
+                    heap.push_back({nd, q});
+                    push_heap(heap.begin(), heap.end(), cmp);
+                }
+            }
+        }
+    }
+};
+
+struct BucketEntry {
+    int target;
+    double dist;
+    int entry;          // in the target's backward tree, when keeping paths
+};
+
+template <class Job>
+void run_parallel(int count, int num_threads, Job job) {
+    atomic<int> next{0};
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) job(i);
+    };
+    num_threads = max(1, min(num_threads, count));
+    vector<thread> pool;
+    for (int t = 1; t < num_threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+} // namespace
+
+void many_to_many(const CH& ch, const vector<int>& sources, const vector<int>& targets,
+                  float* table, int num_threads, MeetingPaths* paths, float* extra_table)
+{
+    int n = ch.n;
+    int S = sources.size(), T = targets.size();
+    int W = extra_table ? ch.extra_width : 0;
+    if (paths) {
+        paths->forward.assign(S, {});
+        paths->backward.assign(T, {});
+        paths->meet.assign((size_t)S * T * 2, -1);
+    }
+
+    // Settled nodes become tree entries in settle order, so a parent's
+    // entry is always known by the time its children are settled.
+    auto grow = [](vector<TreeEntry>& tree, vector<int>& entry_of, const UpwardSearch& search, int p) {
+        entry_of[p] = tree.size();
+        int from = search.from[p];
+        tree.push_back({from < 0 ? -1 : entry_of[from], search.via[p]});
+    };
+    // side labels by position, set as nodes settle, likewise after their parent's
+    auto label = [W](vector<float>& lab, const UpwardSearch& search, int p, const vector<float>& arc_extra) {
+        float* to = &lab[(size_t)p * W];
+        int from = search.from[p];
+        if (from < 0) {
+            fill_n(to, W, 0.0f);
+            return;
+        }
+        const float* at = &lab[(size_t)from * W];
+        const float* arc = &arc_extra[(size_t)search.via[p] * W];
+        for (int c = 0; c < W; c++) to[c] = at[c] + arc[c];
+    };
+
+    // backward searches: each target's search space, as (position, target, dist)
+    vector<vector<pair<int, BucketEntry>>> spaces(T);
+    vector<vector<float>> space_extra(T);
+    run_parallel(T, num_threads, [&](int j) {
+        thread_local UpwardSearch search(0);
+        thread_local vector<int> entry_of;
+        thread_local vector<float> lab;
+        if ((int)search.dist.size() != n) {
+            search = UpwardSearch(n);
+            entry_of.assign(n, -1);
+        }
+        lab.resize((size_t)n * W);
+        search.run(ch, ch.pos[targets[j]], true, [&](int p, double d) {
+            int entry = -1;
+            if (paths) {
+                grow(paths->backward[j], entry_of, search, p);
+                entry = entry_of[p];
+            }
+            spaces[j].push_back({p, {j, d, entry}});
+            if (W == 0) return;
+            label(lab, search, p, ch.down_extra);
+            space_extra[j].insert(space_extra[j].end(), &lab[(size_t)p * W], &lab[(size_t)p * W] + W);
+        });
+    });
+
+    // buckets in CSR form, keyed by position
+    vector<int> bucket_first(n + 1, 0);
+    for (auto& sp : spaces)
+        for (auto& e : sp) bucket_first[e.first + 1]++;
+    for (int p = 0; p < n; p++) bucket_first[p + 1] += bucket_first[p];
+    vector<BucketEntry> buckets(bucket_first[n]);
+    vector<float> bucket_extra((size_t)bucket_first[n] * W);
+    {
+        vector<int> fill(bucket_first.begin(), bucket_first.end() - 1);
+        for (int j = 0; j < T; j++)
+            for (size_t e = 0; e < spaces[j].size(); e++) {
+                int at = fill[spaces[j][e].first]++;
+                buckets[at] = spaces[j][e].second;
+                copy_n(space_extra[j].data() + e * W, W, &bucket_extra[(size_t)at * W]);
+            }
+    }
+    spaces.clear();
+    space_extra.clear();
+
+    // forward searches: row i only ever touched by the thread owning source i
+    run_parallel(S, num_threads, [&](int i) {
+        thread_local UpwardSearch search(0);
+        thread_local vector<int> entry_of;
+        thread_local vector<double> row;
+        thread_local vector<float> lab;
+        thread_local vector<int> best_p, best_k;
+        if ((int)search.dist.size() != n) {
+            search = UpwardSearch(n);
+            entry_of.assign(n, -1);
+        }
+        row.assign(T, INF);
+        lab.resize((size_t)n * W);
+        if (W > 0) {
+            best_p.assign(T, -1);
+            best_k.assign(T, -1);
+        }
+        int32_t* meet = paths ? &paths->meet[(size_t)i * T * 2] : nullptr;
+        search.run(ch, ch.pos[sources[i]], false, [&](int p, double d) {
+            if (paths) grow(paths->forward[i], entry_of, search, p);
+            if (W > 0) label(lab, search, p, ch.up_extra);
+            for (int k = bucket_first[p]; k < bucket_first[p + 1]; k++) {
+                const BucketEntry& b = buckets[k];
+                double nd = d + b.dist;
+                if (nd < row[b.target]) {
+                    row[b.target] = nd;
+                    if (meet) {
+                        meet[2 * b.target] = entry_of[p];
+                        meet[2 * b.target + 1] = b.entry;
+                    }
+                    if (W > 0) {
+                        best_p[b.target] = p;
+                        best_k[b.target] = k;
+                    }
+                }
+            }
+        });
+        for (int j = 0; j < T; j++) table[(size_t)i * T + j] = (float)row[j];
+        for (int j = 0; j < T && W > 0; j++) {
+            float* out = extra_table + ((size_t)i * T + j) * W;
+            if (best_p[j] < 0) {
+                fill_n(out, W, 0.0f);
+                continue;
+            }
+            const float* up = &lab[(size_t)best_p[j] * W];
+            const float* down = &bucket_extra[(size_t)best_k[j] * W];
+            for (int c = 0; c < W; c++) out[c] = up[c] + down[c];
+        }
+    });
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include "graph.hpp"
+#include <cstdint>
+#include <vector>
+
+// Contraction hierarchy over a DenseGraph. Nodes are renumbered by sweep
+// position: position 0 is the most important node (contracted last), so
+// every upward arc points to a smaller position and a PHAST downward sweep
+// is a single pass over positions 0..n-1.
+struct CH {
+    int n = 0;
+    std::vector<int> node_at;      // position -> dense node index
+    std::vector<int> pos;          // dense node index -> position
+
+    // upward arcs p -> q (q < p), grouped by tail p
+    std::vector<int> up_first, up_head;
+    std::vector<double> up_weight;
+    std::vector<int> up_mid;       // contracted middle node (dense index), -1 for a road edge
+
+    // downward arcs q -> p (q < p), grouped by head p
+    std::vector<int> down_first, down_tail;
+    std::vector<double> down_weight;
+    std::vector<int> down_mid;
+
+    // optional side labels carried along shortest paths, extra_width
+    // floats per arc (see attach_extras)
+    int extra_width = 0;
+    std::vector<float> up_extra, down_extra;
+};
+
+CH build_ch(const DenseGraph& dg);
+
+// How to turn an arc of the hierarchy back into road nodes: its head in
+// road direction (a position) and, for a shortcut u -> v via m, the arcs
+// it replaces, u -> m among the downward arcs (left) and m -> v among the
+// upward ones (right). left is -1 for a road edge.
+struct UnpackArc {
+    int32_t head, left, right;
+};
+void unpack_arcs(const CH& ch, std::vector<UnpackArc>& up, std::vector<UnpackArc>& down);
+
+// Gives every arc width side labels: arc_extra holds width floats per
+// DenseGraph arc, and a shortcut gets the sums over the arcs it replaces.
+void attach_extras(CH& ch, const DenseGraph& dg, const std::vector<float>& arc_extra, int width);
+
+// Number of sources PHAST sweeps together; distances for one node sit in
+// PHAST_LANES consecutive doubles so the sweep's min-plus vectorises.
+constexpr int PHAST_LANES = 8;
+
+struct PhastWorkspace {
+    std::vector<double> lanes;
+    std::vector<float> extras;
+    std::vector<std::pair<double,int>> heap;
+};
+
+// One-to-all distances for up to PHAST_LANES sources (dense indices).
+// rows[i] receives n distances in dense node order for sources[i]. With
+// extra_rows, extra_rows[i] also receives n * ch.extra_width side labels
+// summed along the shortest path found, which takes a slower sweep.
+void phast_rows(const CH& ch, const int* sources, int count, double* const* rows, PhastWorkspace& ws,
+                float* const* extra_rows = nullptr);
+
+// Many-to-many distances by bucket scanning: one backward upward search per
+// target fills buckets, one forward upward search per source scans them.
+// table[i * targets.size() + j] receives d(sources[i], targets[j]) in
+// seconds (1e18 when unreachable). Sources and targets are dense indices.
+// With paths, also the search trees and where they meet, enough to
+// rebuild any pair's hierarchy path without searching. With extra_table,
+// entry i * targets.size() + j also receives ch.extra_width side labels
+// summed along that pair's path, as phast_rows gives them.
+struct TreeEntry {
+    int32_t parent;     // entry in the same tree, -1 at the root
+    int32_t arc;        // upward arc from the parent (forward trees) or
+                        // downward arc to the parent (backward trees)
+};
+struct MeetingPaths {
+    std::vector<std::vector<TreeEntry>> forward, backward;  // per source / target
+    std::vector<int32_t> meet;  // per pair two entries, in forward[i] and backward[j]; -1 if none
+};
+
+void many_to_many(const CH& ch, const std::vector<int>& sources, const std::vector<int>& targets,
+                  float* table, int num_threads, MeetingPaths* paths = nullptr,
+                  float* extra_table = nullptr);
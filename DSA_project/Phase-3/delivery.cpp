@@ -1,4 +1,9 @@
 #include "delivery.hpp"
+#include "precomputed.hpp"
+#include "routes.hpp"
+#include "alns.hpp"
+#include "ch.hpp"
+#include "fallback.hpp"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -10,60 +15,251 @@
 #include <algorithm>
 #include <limits>
 #include <set>
+#include <numeric>
+#include <atomic>
+#include <thread>
+#include <mutex>
 using namespace std;
 
-static vector<int> important_nodes;
-static vector<int> all_nodes;
-static unordered_map<int,int> id_to_row;
-static unordered_map<int,int> id_to_col;
-static vector<vector<double>> distTable;
-static vector<double> radius_vals;
-static vector<double> angle_vals;
-
-bool load_precomputed(const string &file)
+// Views into the mapped precomputed.bin; important_ids is sorted, so the
+// row of a node is found by binary search.
+static PrecomputedFile precomputed;
+static const int32_t* important_ids = nullptr;
+static int num_important = 0;
+static const float* distTable = nullptr;   // M x M, row-major, seconds
+
+// Speed profile sections, used once use_time_profiles() turns them on.
+static const float* slowdown = nullptr;     // classes x SPEED_SLOTS
+static const float* level_table = nullptr;  // M x M
+static const uint8_t* share_table = nullptr;  // M x M x classes
+static int num_classes = 0;
+static double departure_time = -1.0;        // < 0: static travel times
+
+// Road path sections, all null if the file has none.
+static const int32_t* ch_nodes = nullptr;
+static const UnpackArc* unpack_up = nullptr;
+static const UnpackArc* unpack_down = nullptr;
+static const int64_t* tree_first = nullptr;
+static const TreeEntry* trees = nullptr;
+static const int32_t* meet_table = nullptr;
+
+// Nodes the table lacks get rows past it on first sight, answered by
+// searches over the loaded graph; the fallback is only set up once such a
+// node turns up.
+static const Graph* loaded_graph = nullptr;
+static size_t fallback_bytes = 0;
+static DistanceFallback fallback;
+static once_flag fallback_once;
+static bool fallback_used = false;
+
+static int table_row(int id)
 {
-    ifstream fin(file, ios::binary);
-    if (!fin) return false;
+    const int32_t* end = important_ids + num_important;
+    const int32_t* it = lower_bound(important_ids, end, id);
+    return (it != end && *it == id) ? int(it - important_ids) : -1;
+}
 
-    int M, N;
-    fin.read((char*)&M, sizeof(int));
-    fin.read((char*)&N, sizeof(int));
+static bool in_table(int row)
+{
+    return row >= 0 && row < num_important;
+}
 
-    important_nodes.resize(M);
-    fin.read((char*)important_nodes.data(), M * sizeof(int));
+static int row_of(int id)
+{
+    int row = table_row(id);
+    if (row >= 0 || !loaded_graph) return row;
+    call_once(fallback_once, [] {
+        fallback.init(*loaded_graph, vector<int>(important_ids, important_ids + num_important), fallback_bytes);
+        fallback_used = true;
+    });
+    return fallback.target(id);
+}
 
-    all_nodes.resize(N);
-    fin.read((char*)all_nodes.data(), N * sizeof(int));
+// Entry between two rows, 1e18f when unreachable.
+static float pair_time(int ru, int rv)
+{
+    if (ru < num_important && rv < num_important) return distTable[(size_t)ru * num_important + rv];
+    return fallback.time(ru, rv);
+}
 
-    id_to_row.clear();
-    id_to_col.clear();
-    
-    for (int i = 0; i < M; i++)
-        id_to_row[important_nodes[i]] = i;
-    
-    for (int i = 0; i < N; i++)
-        id_to_col[all_nodes[i]] = i;
+bool load_precomputed(const string &file, const Graph& g, const vector<Order>& orders, int depot,
+                      size_t cache_bytes, bool verify_payload)
+{
+    string error;
+    if (!precomputed.open(file, error, verify_payload)) {
+        cerr << error << "\n";
+        return false;
+    }
+    const PrecomputedHeader& h = precomputed.header();
+    size_t M = h.m;
 
-    distTable.assign(M, vector<double>(N));
-    for (int i = 0; i < M; i++)
-        fin.read((char*)distTable[i].data(), N * sizeof(double));
+    if (h.graph_hash != graph_fingerprint(g)) {
+        cerr << file << " was built for a different graph; rerun ./precompute\n";
+        return false;
+    }
 
-    radius_vals.resize(N);
-    angle_vals.resize(N);
+    size_t ids_bytes = 0, dist_bytes = 0;
+    important_ids = (const int32_t*)precomputed.section(SEC_IDS, &ids_bytes);
+    distTable = (const float*)precomputed.section(SEC_DIST, &dist_bytes);
+    if (!important_ids || !distTable
+        || ids_bytes != M * sizeof(int32_t) || dist_bytes != M * M * sizeof(float)) {
+        cerr << file << " is missing sections or has the wrong dimensions\n";
+        return false;
+    }
+    num_important = M;
+    loaded_graph = &g;
+    fallback_bytes = cache_bytes;
+
+    vector<int> wanted = {depot};
+    for (auto& o : orders) {
+        wanted.push_back(o.pickup);
+        wanted.push_back(o.dropoff);
+    }
+    sort(wanted.begin(), wanted.end());
+    wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+    // nodes of another queries file still work, just slower
+    int missing = 0;
+    for (int id : wanted) missing += table_row(id) < 0 && row_of(id) >= 0;
+    if (missing > 0)
+        cerr << missing << " depot/order nodes are not in " << file
+             << "; searching for them on demand (rerun ./precompute to include them)\n";
+
+    size_t slow_bytes = 0, level_bytes = 0, share_bytes = 0;
+    slowdown = (const float*)precomputed.section(SEC_SLOWDOWN, &slow_bytes);
+    level_table = (const float*)precomputed.section(SEC_LEVEL, &level_bytes);
+    share_table = (const uint8_t*)precomputed.section(SEC_SHARE, &share_bytes);
+    num_classes = slow_bytes / (SPEED_SLOTS * sizeof(float));
+    if (!slowdown || !level_table || !share_table
+        || level_bytes != M * M * sizeof(float) || share_bytes != M * M * num_classes) {
+        slowdown = nullptr;
+        level_table = nullptr;
+        share_table = nullptr;
+        num_classes = 0;
+    }
 
-    fin.read((char*)radius_vals.data(), N * sizeof(double));
-    fin.read((char*)angle_vals.data(), N * sizeof(double));
+    size_t first_bytes = 0, trees_bytes = 0, meet_bytes = 0;
+    ch_nodes = (const int32_t*)precomputed.section(SEC_CH_NODES);
+    unpack_up = (const UnpackArc*)precomputed.section(SEC_UNPACK_UP);
+    unpack_down = (const UnpackArc*)precomputed.section(SEC_UNPACK_DOWN);
+    tree_first = (const int64_t*)precomputed.section(SEC_TREE_FIRST, &first_bytes);
+    trees = (const TreeEntry*)precomputed.section(SEC_TREES, &trees_bytes);
+    meet_table = (const int32_t*)precomputed.section(SEC_MEET, &meet_bytes);
+    if (!ch_nodes || !unpack_up || !unpack_down || !tree_first || !meet_table
+        || first_bytes != (2 * M + 1) * sizeof(int64_t) || meet_bytes != M * M * 2 * sizeof(int32_t)
+        || trees_bytes != tree_first[2 * M] * sizeof(TreeEntry))
+        meet_table = nullptr;
+    return true;
+}
 
+bool use_time_profiles(double departure)
+{
+    if (num_classes == 0) return false;
+    departure_time = departure;
     return true;
 }
 
-static double shortest_time(int u, int v)
+double travel_time(int u, int v, double t)
+{
+    double d = shortest_time(u, v);
+    if (departure_time < 0.0 || d <= 0.0 || d >= 1e18) return d;
+    int ru = row_of(u), rv = row_of(v);
+    if (!in_table(ru) || !in_table(rv)) return d;
+    size_t pair = (size_t)ru * num_important + rv;
+    const uint8_t* f = &share_table[pair * num_classes];
+    int slot = (long long)floor((departure_time + t) / SLOT_SECONDS) % SPEED_SLOTS;
+    double x = 0.0;
+    for (int c = 0; c < num_classes; c++) x += f[c] * slowdown[(size_t)c * SPEED_SLOTS + slot];
+    return d * level_table[pair] * (1.0 + x / 255.0);
+}
+
+int precomputed_row(int node)
+{
+    return row_of(node);
+}
+
+float row_distance(int ru, int rv)
+{
+    return pair_time(ru, rv);
+}
+
+FallbackStats fallback_stats()
+{
+    FallbackStats stats;
+    if (!fallback_used) return stats;
+    stats.hits = fallback.hits();
+    stats.misses = fallback.misses();
+    stats.nodes = fallback.targets() - num_important;
+    return stats;
+}
+double shortest_time(int u, int v)
 {
     if (u == v) return 0.0;
-    if (id_to_row.find(u) == id_to_row.end()) return 1e18;
-    if (id_to_col.find(v) == id_to_col.end()) return 1e18;
-    
-    return distTable[id_to_row[u]][id_to_col[v]];
+    int ru = row_of(u);
+    if (ru < 0) return 1e18;
+    int rv = row_of(v);
+    if (rv < 0) return 1e18;
+
+    // unreachable pairs are stored as (float)1e18; hand back the exact sentinel
+    float d = pair_time(ru, rv);
+    return d >= 1e17f ? 1e18 : d;
+}
+
+// Appends the road nodes of one hierarchy arc, shortcuts replaced by the
+// arcs they stand for, left part first.
+static void unpack(const UnpackArc* arc, vector<int>& out)
+{
+    thread_local vector<const UnpackArc*> stack;
+    stack.assign(1, arc);
+    while (!stack.empty()) {
+        const UnpackArc* a = stack.back();
+        stack.pop_back();
+        if (a->left < 0) {
+            out.push_back(ch_nodes[a->head]);
+            continue;
+        }
+        stack.push_back(&unpack_up[a->right]);
+        stack.push_back(&unpack_down[a->left]);
+    }
+}
+
+// Appends the nodes after u on a shortest u -> v path: the upward part is
+// the forward tree of u read from the meeting entry back to the root, the
+// downward part the backward tree of v read from the meeting entry on.
+// Legs to or from fallback nodes are searched instead.
+static bool append_leg(int u, int v, vector<int>& out)
+{
+    if (u == v) return true;
+    int ru = row_of(u), rv = row_of(v);
+    if (ru < 0 || rv < 0) return false;
+    if (!in_table(ru) || !in_table(rv)) return fallback.path(u, v, out);
+    const int32_t* m = &meet_table[((size_t)ru * num_important + rv) * 2];
+    if (m[0] < 0) return false;
+
+    const TreeEntry* fwd = trees + tree_first[ru];
+    thread_local vector<int> up;
+    up.clear();
+    for (int e = m[0]; fwd[e].parent >= 0; e = fwd[e].parent) up.push_back(fwd[e].arc);
+    for (int i = up.size() - 1; i >= 0; i--) unpack(&unpack_up[up[i]], out);
+    const TreeEntry* bwd = trees + tree_first[num_important + rv];
+    for (int e = m[1]; bwd[e].parent >= 0; e = bwd[e].parent) unpack(&unpack_down[bwd[e].arc], out);
+    return true;
+}
+
+bool has_road_paths()
+{
+    return meet_table != nullptr;
+}
+
+vector<int> road_path(const vector<int>& route)
+{
+    if (!meet_table || route.empty()) return {};
+    vector<int> path = {route[0]};
+    for (int i = 0; i + 1 < (int)route.size(); i++)
+        if (!append_leg(route[i], route[i + 1], path)) {
+            cerr << "No road path for leg " << route[i] << " -> " << route[i + 1] << "\n";
+            return {};
+        }
+    return path;
 }
 
 static bool is_valid_route(const vector<int>& route, const vector<Order>& orders) {
@@ -98,206 +294,309 @@ static bool is_valid_route(const vector<int>& route, const vector<Order>& orders
     return true;
 }
 
-static vector<int> greedy_route(const vector<Order>& orders, int depot) {
-    if (orders.empty()) return {depot};
-    
-    vector<int> route = {depot};
-    vector<bool> picked_up(orders.size(), false);
-    vector<bool> delivered(orders.size(), false);
-    int current = depot;
-    int remaining = orders.size() * 2;
-
-    while (remaining > 0) {
-        double best = 1e18;
-        int best_node = -1;
-        int best_idx = -1;
-        bool is_pickup = true;
-
-        for (int i = 0; i < (int)orders.size(); i++) {
-            if (!picked_up[i]) {
-                double d = shortest_time(current, orders[i].pickup);
-                if (d < best) {
-                    best = d;
-                    best_node = orders[i].pickup;
-                    best_idx = i;
-                    is_pickup = true;
-                }
-            }
-            else if (picked_up[i] && !delivered[i]) {
-                double d = shortest_time(current, orders[i].dropoff);
-                if (d < best) {
-                    best = d;
-                    best_node = orders[i].dropoff;
-                    best_idx = i;
-                    is_pickup = false;
-                }
-            }
-        }
-
-        if (best_idx == -1) break;
+static ClusterStops build_stops(const vector<Order>& orders, int depot, int capacity)
+{
+    ClusterStops cs;
+    cs.k = 2 * orders.size() + 1;
+    cs.node.reserve(cs.k);
+    cs.node.push_back(depot);
+    for (auto& o : orders) {
+        cs.node.push_back(o.pickup);
+        cs.node.push_back(o.dropoff);
+    }
 
-        if (best_node != current || orders[best_idx].pickup == orders[best_idx].dropoff) {
-            route.push_back(best_node);
-            current = best_node;
+    // constraint tables only when something uses them, so that plain
+    // instances keep the unconstrained fast paths
+    cs.capacity = capacity;
+    if (capacity > 0) {
+        cs.load = {0};
+        for (auto& o : orders) {
+            cs.load.push_back(o.load);
+            cs.load.push_back(-o.load);
         }
+    }
+    if (any_of(orders.begin(), orders.end(), [](const Order& o) { return o.has_windows(); })) {
+        cs.earliest = {0.0};
+        cs.latest = {0.0};
+        for (auto& o : orders) {
+            cs.earliest.push_back(o.pickup_open);
+            cs.earliest.push_back(o.dropoff_open);
+            cs.latest.push_back(o.pickup_close);
+            cs.latest.push_back(o.dropoff_close);
+        }
+    }
 
-        if (is_pickup) {
-            picked_up[best_idx] = true;
-        } else {
-            delivered[best_idx] = true;
+    vector<int> row(cs.k);
+    for (int a = 0; a < cs.k; a++) row[a] = row_of(cs.node[a]);
+    if (departure_time >= 0.0) {
+        int C = num_classes;
+        cs.classes = C;
+        cs.departure = departure_time;
+        cs.slowdown.assign(slowdown, slowdown + (size_t)C * SPEED_SLOTS);
+        cs.level.assign((size_t)cs.k * cs.k, 1.0f);
+        cs.share.assign((size_t)cs.k * cs.k * C, 0);
+        for (int a = 0; a < cs.k; a++)
+            for (int b = 0; b < cs.k; b++) {
+                if (!in_table(row[a]) || !in_table(row[b])) continue;
+                size_t pair = (size_t)row[a] * num_important + row[b], at = (size_t)a * cs.k + b;
+                cs.level[at] = level_table[pair];
+                copy_n(&share_table[pair * C], C, &cs.share[at * C]);
+            }
+    }
+    cs.cost.resize((size_t)cs.k * cs.k);
+    for (int a = 0; a < cs.k; a++) {
+        float* out = &cs.cost[(size_t)a * cs.k];
+        const float* in = in_table(row[a]) ? &distTable[(size_t)row[a] * num_important] : nullptr;
+        for (int b = 0; b < cs.k; b++) {
+            if (cs.node[a] == cs.node[b]) out[b] = 0.0f;
+            else if (row[a] < 0 || row[b] < 0) out[b] = 1e18f;
+            else if (in && in_table(row[b])) out[b] = in[row[b]];
+            else out[b] = pair_time(row[a], row[b]);
         }
-        remaining--;
     }
+    return cs;
+}
 
-    return route;
+// Travel time between two table rows, unreachable capped as in the route
+// searches so sums stay finite.
+static double row_time(int a, int b)
+{
+    float d = pair_time(a, b);
+    return d >= 1e17f ? ClusterStops::UNREACHABLE : d;
 }
 
-static double route_cost(const vector<int>& route) {
-    if (route.size() <= 1) return 0.0;
-    
-    double cost = 0.0;
-    for (int i = 0; i < (int)route.size() - 1; i++) {
-        cost += shortest_time(route[i], route[i+1]);
+// Assigns n items to K clusters of about cap items each, minimising the
+// total of cost[i * K + c]. Forward auction with epsilon scaling over cap
+// slots per cluster, plus one overflow slot per cluster that starts at the
+// largest cost: an item only overflows a cluster if that is worth it, and
+// free overflow slots stop prices from inflating when all regular slots are
+// taken. Each cluster tracks its two cheapest slot prices, so a bid costs
+// O(K + cap).
+static vector<int> auction_assign(const vector<double>& cost, int n, int K, int cap)
+{
+    const double NONE = numeric_limits<double>::infinity();
+    int slots = cap + 1;
+    vector<double> price((size_t)K * slots, 0.0);
+    vector<int> owner((size_t)K * slots, -1);
+    vector<int> slot_of(n, -1);
+    vector<int> low(K, 0);                      // cheapest slot of each cluster
+    vector<double> low1(K), low2(K);
+
+    auto rescan = [&](int c) {
+        low1[c] = low2[c] = NONE;
+        for (int k = 0; k < slots; k++) {
+            double p = price[(size_t)c * slots + k];
+            if (p < low1[c]) { low2[c] = low1[c]; low1[c] = p; low[c] = c * slots + k; }
+            else if (p < low2[c]) low2[c] = p;
+        }
+    };
+
+    double max_cost = *max_element(cost.begin(), cost.end());
+    double mean_cost = accumulate(cost.begin(), cost.end(), 0.0) / cost.size();
+    for (int c = 0; c < K; c++) {
+        price[(size_t)c * slots + cap] = max_cost;
+        rescan(c);
     }
-    return cost;
-}
 
-static void two_opt_improve(vector<int>& route, const vector<Order>& orders) {
-    if (route.size() <= 3) return;
-    
-    bool improved = true;
-    int iterations = 0;
-    const int MAX_ITER = 200;
-    
-    while (improved && iterations < MAX_ITER) {
-        improved = false;
-        iterations++;
-        double best_cost = route_cost(route);
-        
-        for (int i = 1; i < (int)route.size() - 2; i++) {
-            for (int j = i + 1; j < (int)route.size() - 1; j++) {
-                vector<int> new_route = route;
-                reverse(new_route.begin() + i, new_route.begin() + j + 1);
-                
-                if (is_valid_route(new_route, orders)) {
-                    double new_cost = route_cost(new_route);
-                    if (new_cost < best_cost - 1e-9) {
-                        route = new_route;
-                        best_cost = new_cost;
-                        improved = true;
-                        break;
-                    }
-                }
+    // the result is within n * eps_min of optimal; a thousandth of a typical cost is plenty
+    double eps = max(max_cost / 4, 1e-6);
+    double eps_min = max(mean_cost * 1e-3, 1e-6);
+    vector<int> queue;
+    while (true) {
+        fill(owner.begin(), owner.end(), -1);
+        fill(slot_of.begin(), slot_of.end(), -1);
+        queue.resize(n);
+        for (int i = 0; i < n; i++) queue[i] = n - 1 - i;
+
+        while (!queue.empty()) {
+            int i = queue.back(); queue.pop_back();
+            const double* row = &cost[(size_t)i * K];
+            int best = 0;
+            double v1 = -NONE, w2 = -NONE;
+            for (int c = 0; c < K; c++) {
+                double v = -row[c] - low1[c];
+                if (v > v1) { w2 = v1; v1 = v; best = c; }
+                else if (v > w2) w2 = v;
+            }
+            w2 = max(w2, -row[best] - low2[best]);
+            double raise = w2 == -NONE ? eps : v1 - w2 + eps;
+
+            int s = low[best];
+            price[s] += raise;
+            if (owner[s] >= 0) {
+                slot_of[owner[s]] = -1;
+                queue.push_back(owner[s]);
             }
-            if (improved) break;
+            owner[s] = i;
+            slot_of[i] = s;
+            rescan(best);
         }
+        if (eps <= eps_min) break;
+        eps = max(eps / 8, eps_min);
     }
-}
 
-struct OrderInfo {
-    Order order;
-    double r, a;
-    int idx;
-};
+    vector<int> cluster(n);
+    for (int i = 0; i < n; i++) cluster[i] = slot_of[i] / slots;
+    return cluster;
+}
 
-static vector<vector<Order>> balanced_cluster(const vector<Order>& orders, int drivers) {
-    if (orders.empty()) {
-        return vector<vector<Order>>(drivers);
-    }
-    vector<OrderInfo> info;
+// Capacity-balanced k-medoids over orders in road travel time: two orders
+// are close when their pickups and their dropoffs are close both ways.
+// Medoids start spread out (farthest-first from the depot); each round
+// assigns orders to medoids with about ceil(n / K) per driver, then moves
+// every medoid to the member closest to the rest of its cluster.
+static vector<vector<Order>> balanced_cluster(const vector<Order>& orders, int drivers, int depot) {
+    vector<vector<Order>> clusters(drivers);
+    vector<int> idx, rp, rd;
     for (int i = 0; i < (int)orders.size(); i++) {
-        auto &o = orders[i];
-        if (id_to_col.find(o.pickup) == id_to_col.end()) continue;
-        int pickup_col = id_to_col[o.pickup];
-        OrderInfo oi{o, radius_vals[pickup_col], angle_vals[pickup_col], i};
-        info.push_back(oi);
+        int p = row_of(orders[i].pickup);
+        if (p < 0) continue;
+        int d = row_of(orders[i].dropoff);
+        idx.push_back(i);
+        rp.push_back(p);
+        rd.push_back(d >= 0 ? d : p);
     }
-
-    if (info.empty()) {
-        return vector<vector<Order>>(drivers);
+    int n = idx.size();
+    if (n == 0 || drivers <= 0) return clusters;
+
+    int K = min(drivers, n);
+    int cap = (n + K - 1) / K;
+    auto between = [&](int a, int b) {
+        return row_time(rp[a], rp[b]) + row_time(rp[b], rp[a])
+             + row_time(rd[a], rd[b]) + row_time(rd[b], rd[a]);
+    };
+
+    int depot_row = row_of(depot);
+    int first = 0;
+    double first_time = -1.0;
+    for (int i = 0; i < n; i++) {
+        double t = depot_row >= 0 ? row_time(depot_row, rp[i]) : 0.0;
+        if (t > first_time) { first = i; first_time = t; }
     }
-
-    int num_angular_sectors = max(1, (int)sqrt(drivers));
-    int num_radial_zones = (drivers + num_angular_sectors - 1) / num_angular_sectors;
-    
-    vector<double> radii;
-    for (auto &oi : info) radii.push_back(oi.r);
-    sort(radii.begin(), radii.end());
-    
-    vector<double> zone_boundaries;
-    zone_boundaries.push_back(0.0);
-    for (int z = 1; z < num_radial_zones; z++) {
-        int idx = (radii.size() * z) / num_radial_zones;
-        zone_boundaries.push_back(radii[idx]);
+    vector<int> medoid = {first};
+    vector<double> nearest(n);
+    for (int i = 0; i < n; i++) nearest[i] = between(i, first);
+    while ((int)medoid.size() < K) {
+        int far = max_element(nearest.begin(), nearest.end()) - nearest.begin();
+        medoid.push_back(far);
+        for (int i = 0; i < n; i++) nearest[i] = min(nearest[i], between(i, far));
     }
-    zone_boundaries.push_back(1e18);
-    
-    const double PI = acos(-1.0);
-    double sector_size = 2 * PI / num_angular_sectors;
-    
-    vector<vector<vector<Order>>> grid(num_angular_sectors, vector<vector<Order>>(num_radial_zones));
-    
-    for (auto &oi : info) {
-        double norm_angle = oi.a;
-        while (norm_angle < 0) norm_angle += 2 * PI;
-        while (norm_angle >= 2 * PI) norm_angle -= 2 * PI;
-        
-        int sector = min((int)(norm_angle / sector_size), num_angular_sectors - 1);
-        
-        int zone = 0;
-        for (int z = 0; z < num_radial_zones; z++) {
-            if (oi.r >= zone_boundaries[z] && oi.r < zone_boundaries[z + 1]) {
-                zone = z;
-                break;
+
+    const int MAX_ROUNDS = 8;
+    vector<int> cluster;
+    vector<double> cost((size_t)n * K);
+    for (int round = 0; round < MAX_ROUNDS; round++) {
+        for (int i = 0; i < n; i++)
+            for (int c = 0; c < K; c++)
+                cost[(size_t)i * K + c] = between(i, medoid[c]);
+        cluster = auction_assign(cost, n, K, cap);
+
+        vector<vector<int>> members(K);
+        for (int i = 0; i < n; i++) members[cluster[i]].push_back(i);
+        bool moved = false;
+        for (int c = 0; c < K; c++) {
+            if (members[c].empty()) continue;
+            int best = medoid[c];
+            double best_sum = numeric_limits<double>::infinity();
+            for (int a : members[c]) {
+                double sum = 0.0;
+                for (int b : members[c]) sum += between(a, b);
+                if (sum < best_sum - 1e-9 || (a == medoid[c] && sum <= best_sum + 1e-9)) {
+                    best_sum = sum;
+                    best = a;
+                }
             }
+            if (best != medoid[c]) moved = true;
+            medoid[c] = best;
         }
-        
-        grid[sector][zone].push_back(oi.order);
+        if (!moved) break;
     }
+
+    for (int i = 0; i < n; i++) clusters[cluster[i]].push_back(orders[idx[i]]);
+    return clusters;
+}
+
+// Runs job(0..count-1) on up to threads threads pulling from a shared counter.
+template <class Job>
+static void parallel_for(int count, int threads, Job job)
+{
+    atomic<int> next{0};
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) job(i);
+    };
+    threads = max(1, min(threads, count));
+    vector<thread> pool;
+    for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+    worker();
+    for (auto& th : pool) th.join();
+}
+
+// Heuristic schedule: travel-time clusters, then a nearest-neighbour route
+// per driver polished by local search. stops[d] gets driver d's stop
+// sequence over its cluster (empty if the route could not be completed).
+static vector<DriverAssignment> cluster_schedule(
+    const vector<vector<Order>>& clusters,
+    int depot,
+    const Deadline &deadline,
+    int threads,
+    const ScheduleOptions& options,
+    vector<vector<int>>& stops_out
+) {
+    int drivers = clusters.size();
+    vector<DriverAssignment> assignments(drivers);
+    stops_out.assign(drivers, {});
+
+    // routes are independent; each worker has its own copy of the deadline
+    parallel_for(drivers, threads, [&](int d) {
+        Deadline local = deadline;
+        assignments[d].driver_id = d;
     
-    vector<vector<Order>> clusters(drivers);
-    int driver_idx = 0;
-    
-    for (int s = 0; s < num_angular_sectors; s++) {
-        for (int z = 0; z < num_radial_zones; z++) {
-            if (driver_idx >= drivers) break;
-            
-            for (auto &order : grid[s][z]) {
-                clusters[driver_idx].push_back(order);
-            }
-            
-            if (!grid[s][z].empty()) {
-                driver_idx++;
-            }
+        if (clusters[d].empty()) {
+            assignments[d].route = {depot};
+            return;
         }
-        if (driver_idx >= drivers) break;
-    }
     
-    if (driver_idx>=0) {
-        set<int> assigned_ids;
-        for (auto &cluster : clusters) {
-            for (auto &o : cluster) {
-                assigned_ids.insert(o.order_id);
-            }
+        for (auto &o : clusters[d]) {
+            assignments[d].order_ids.push_back(o.order_id);
+        }
+
+        ClusterStops cs = build_stops(clusters[d], depot, options.capacity);
+        // small clusters are solved exactly unless some order can't be
+        // reached or fit in, which greedy_route already knows to leave out
+        bool exact = (int)clusters[d].size() <= min(options.exact_max_orders, EXACT_MAX_ORDERS)
+                     && !cs.has_windows();
+        vector<int> stops;
+        if (exact) {
+            stops = exact_route(cs);
+            exact = stops_valid(stops, cs);
+            for (int i = 1; i < (int)stops.size() && exact; i++)
+                exact = cs.at(stops[i - 1], stops[i]) < 1e18;
         }
+        if (!exact) stops = greedy_route(cs);
+        assignments[d].route = stops_to_route(stops, cs);
+    
+        if (stops_valid(stops, cs)) {
+            // the exact route is only optimal for static times
+            if (!exact || cs.time_dependent()) improve_route(stops, cs, local);
+            auto improved_route = stops_to_route(stops, cs);
         
-        int round_robin = 0;
-        for (auto &oi : info) {
-            if (assigned_ids.find(oi.order.order_id) == assigned_ids.end()) {
-                clusters[round_robin % drivers].push_back(oi.order);
-                round_robin++;
+            if (is_valid_route(improved_route, clusters[d])) {
+                assignments[d].route = improved_route;
+                stops_out[d] = stops;
             }
         }
-    }
-
-    return clusters;
+    });
+    return assignments;
 }
 
 vector<DriverAssignment> schedule_deliveries(
-    const Graph&,
+    const Graph& g,
     const vector<Order>& orders,
     int drivers,
-    int depot
+    int depot,
+    const Deadline &deadline,
+    const ScheduleOptions &options,
+    ScheduleStats *stats
 ) {
     if (orders.empty()) {
         vector<DriverAssignment> ans(drivers);
@@ -308,65 +607,129 @@ vector<DriverAssignment> schedule_deliveries(
         return ans;
     }
     
-    auto clusters = balanced_cluster(orders, drivers);
-    vector<DriverAssignment> assignments(drivers);
+    int threads = options.threads > 0 ? options.threads : max(1u, thread::hardware_concurrency());
+    auto clusters = balanced_cluster(orders, drivers, depot);
+    vector<vector<int>> cluster_stops;
+    auto assignments = cluster_schedule(clusters, depot, deadline, threads, options, cluster_stops);
+    int heuristic_served = 0;
+    double heuristic_total = compute_total_delivery_time(g, assignments, orders, &heuristic_served);
+    if (stats) {
+        stats->heuristic_total = heuristic_total;
+        stats->final_total = heuristic_total;
+    }
+    if (options.alns_budget_ms <= 0 && options.alns_iterations <= 0) return assignments;
 
+    // ALNS works on one stop numbering over every clustered order; cluster
+    // routes are renumbered into it and incomplete ones start empty.
+    vector<Order> routed;
+    vector<vector<int>> routes(drivers);
     for (int d = 0; d < drivers; d++) {
-        assignments[d].driver_id = d;
-    
-        if (clusters[d].empty()) {
-            assignments[d].route = {depot};
-            continue;
-        }
-    
-        for (auto &o : clusters[d]) {
-            assignments[d].order_ids.push_back(o.order_id);
-        }
+        int base = routed.size();
+        routed.insert(routed.end(), clusters[d].begin(), clusters[d].end());
+        routes[d] = {0};
+        for (int i = 1; i < (int)cluster_stops[d].size(); i++)
+            routes[d].push_back(cluster_stops[d][i] + 2 * base);
+    }
+    ClusterStops cs = build_stops(routed, depot, options.capacity);
+
+    // Portfolio: one ALNS run per thread, each with its own seed; odd runs
+    // rebuild everything by insertion instead of starting from the clusters.
+    // The best total wins, ties going to the lower run, so a fixed iteration
+    // count gives the same schedule for the same seed.
+    int runs = max(1, options.portfolio > 0 ? options.portfolio : threads);
+    vector<AlnsResult> results(runs);
+    parallel_for(runs, threads, [&](int i) {
+        AlnsOptions alns;
+        alns.budget_ms = options.alns_budget_ms;
+        alns.max_iterations = options.alns_iterations;
+        alns.seed = options.seed + i;
+        Deadline local = deadline;
+        vector<vector<int>> start = i % 2 == 0 ? routes : vector<vector<int>>(drivers, {0});
+        results[i] = alns_improve(cs, start, alns, local);
+    });
+    int best_run = 0;
+    for (int i = 1; i < runs; i++)
+        if (make_pair(results[i].unassigned, results[i].cost)
+            < make_pair(results[best_run].unassigned, results[best_run].cost)) best_run = i;
+    AlnsResult& res = results[best_run];
+    if (stats) {
+        stats->portfolio_runs = runs;
+        stats->best_run = best_run;
+    }
 
-        auto route = greedy_route(clusters[d], depot);
-        assignments[d].route = route;
-    
-        if (is_valid_route(route, clusters[d])) {
-            auto improved_route = route;
-            two_opt_improve(improved_route, clusters[d]);
-        
-            if (is_valid_route(improved_route, clusters[d])) {
-                assignments[d].route = improved_route;
-            }
-        }
+    vector<DriverAssignment> improved(drivers);
+    for (int d = 0; d < drivers; d++) {
+        improved[d].driver_id = d;
+        improved[d].route = stops_to_route(res.routes[d], cs);
+        for (int s : res.routes[d])
+            if (s != 0 && ClusterStops::is_pickup(s))
+                improved[d].order_ids.push_back(routed[ClusterStops::order_of(s)].order_id);
     }
-    return assignments;
+    int served = 0;
+    double alns_total = compute_total_delivery_time(g, improved, orders, &served);
+    if (stats) stats->alns_iterations = res.iterations;
+    // leaving orders out lowers the total, so coverage is compared first
+    if (served < heuristic_served || (served == heuristic_served && alns_total >= heuristic_total))
+        return assignments;
+
+    if (stats) stats->final_total = alns_total;
+    return improved;
 }
 
-double compute_total_delivery_time(const Graph&, const vector<DriverAssignment>& assignments, const vector<Order>& orders) {
-    unordered_map<int, Order> order_map;
+double compute_total_delivery_time(const Graph&, const vector<DriverAssignment>& assignments, const vector<Order>& orders,
+                                   int* delivered) {
+    unordered_map<int, const Order*> order_map;
     for (auto &o : orders) {
-        order_map[o.order_id] = o;
+        order_map[o.order_id] = &o;
     }
 
     double total_time = 0.0;
+    if (delivered) *delivered = 0;
 
+    // Per driver, index its orders by node so each route step only looks at
+    // the orders that touch it: O(route + orders) instead of their product.
+    unordered_map<int, vector<int>> at_node;     // node -> indices into order_ids
+    vector<char> picked;
     for (auto &driver : assignments) {
         if (driver.route.size() <= 1) continue;
-        
-        double elapsed = 0.0;
-        unordered_set<int> picked;
 
+        at_node.clear();
+        picked.assign(driver.order_ids.size(), 0);
+        for (int k = 0; k < (int)driver.order_ids.size(); k++) {
+            auto it = order_map.find(driver.order_ids[k]);
+            if (it == order_map.end()) continue;
+            at_node[it->second->pickup].push_back(k);
+            if (it->second->dropoff != it->second->pickup)
+                at_node[it->second->dropoff].push_back(k);
+        }
+
+        double elapsed = 0.0;
         for (int i = 0; i < (int)driver.route.size() - 1; i++) {
-            elapsed += shortest_time(driver.route[i], driver.route[i + 1]);
-            
+            elapsed += travel_time(driver.route[i], driver.route[i + 1], elapsed);
+
             int current_node = driver.route[i + 1];
-            
-            for (int order_id : driver.order_ids) {
-                if (order_map.find(order_id) == order_map.end()) continue;
-                
-                auto &order = order_map[order_id];
-                
+            auto it = at_node.find(current_node);
+            if (it == at_node.end()) continue;
+
+            // service waits for a window to open; an order with a window
+            // holds the driver at the first visit of its node
+            for (int k : it->second) {
+                auto &order = *order_map[driver.order_ids[k]];
+                if (current_node == order.pickup && !picked[k]) {
+                    elapsed = max(elapsed, order.pickup_open);
+                }
+                else if (current_node == order.dropoff && picked[k] == 1) {
+                    elapsed = max(elapsed, order.dropoff_open);
+                }
+            }
+            for (int k : it->second) {
+                auto &order = *order_map[driver.order_ids[k]];
                 if (current_node == order.pickup) {
-                    picked.insert(order_id);
+                    picked[k] = 1;
                 }
-                else if (current_node == order.dropoff && picked.count(order_id)) {
+                else if (current_node == order.dropoff && picked[k]) {
                     total_time += elapsed;
+                    if (delivered && elapsed < 1e18) ++*delivered;
                 }
             }
         }
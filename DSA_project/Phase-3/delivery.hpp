@@ -1,11 +1,22 @@
 #pragma once
 #include "graph.hpp"
+#include "deadline.hpp"
+#include <cstdint>
 #include <vector>
 
 struct Order {
     int order_id;
     int pickup;
     int dropoff;
+    int load = 1;                   // units on board between pickup and dropoff
+    // service windows in seconds after the drivers leave the depot;
+    // arriving early means waiting, arriving late is not allowed
+    double pickup_open = 0.0, pickup_close = 1e18;
+    double dropoff_open = 0.0, dropoff_close = 1e18;
+
+    bool has_windows() const {
+        return pickup_open > 0.0 || dropoff_open > 0.0 || pickup_close < 1e18 || dropoff_close < 1e18;
+    }
 };
 
 struct DriverAssignment {
@@ -14,17 +25,90 @@ struct DriverAssignment {
     std::vector<int> order_ids;
 };
 
-bool load_precomputed(const std::string& file);
+// Maps precomputed.bin; fails if it was built for another graph. Nodes
+// the file lacks (another queries file, or orders streamed in later) are
+// served by searches over g, whose results are kept in an LRU cache of
+// about cache_bytes; a warning says how many of this run's nodes that
+// concerns. verify_payload checksums the whole file, not just its section
+// table.
+bool load_precomputed(const std::string& file, const Graph& g, const std::vector<Order>& orders, int depot,
+                      size_t cache_bytes = 64 << 20, bool verify_payload = false);
+
+// Travel time from the loaded table or the fallback; 1e18 if unreachable
+// or if a node is not in the graph.
+double shortest_time(int u, int v);
+
+// For callers that look up many pairs: the row of a node (-1 if it is not
+// in the graph; rows past the table are fallback nodes) and the travel
+// time between two rows, 1e18f when unreachable.
+int precomputed_row(int node);
+float row_distance(int ru, int rv);
+
+// Fallback use so far: row lookups served from the cache, rows searched,
+// and nodes outside precomputed.bin. Misses are what a precompute run
+// that includes those nodes would save.
+struct FallbackStats {
+    long hits = 0, misses = 0;
+    int nodes = 0;
+};
+FallbackStats fallback_stats();
+
+// Time-dependent travel times from the speed profile sections of
+// precomputed.bin: a leg leaving t seconds after the drivers do is priced
+// at the 15-minute slot it starts in. departure is the time of day the
+// drivers leave the depot, in seconds. Returns false, keeping static
+// times, if the file has no profiles. Windows are still checked against
+// the static times.
+bool use_time_profiles(double departure);
+
+// shortest_time, or its time-dependent value for a leg leaving t seconds
+// after departure once use_time_profiles() is on.
+double travel_time(int u, int v, double t);
+
+// Road nodes along a route of stop nodes, each leg expanded into its
+// shortest path from the hierarchy stored in precomputed.bin: O(path
+// length), no search; legs to or from nodes outside the file take one
+// Dijkstra each. Empty if the file has no path data or some leg has no
+// path, which is reported on stderr.
+std::vector<int> road_path(const std::vector<int>& route);
+
+// Whether precomputed.bin has path data, which precompute only stores
+// when the queries file sets "road_paths".
+bool has_road_paths();
+
+struct ScheduleOptions {
+    double alns_budget_ms = 0;      // ALNS time after the heuristic; 0 skips it
+    long alns_iterations = 0;       // > 0: run this many ALNS iterations instead
+    uint64_t seed = 1;              // run i of the portfolio uses seed + i
+    int threads = 0;                // 0: one per hardware thread
+    int portfolio = 0;              // ALNS runs to keep the best of; 0: one per thread
+    int capacity = 0;               // most load a driver carries at once; 0: unlimited
+    int exact_max_orders = 8;       // clusters this small get an exact route (capped at EXACT_MAX_ORDERS)
+};
+
+struct ScheduleStats {
+    double heuristic_total = 0.0;   // clustering + per-route heuristic
+    double final_total = 0.0;       // what was returned
+    long alns_iterations = 0;       // in the winning run
+    int portfolio_runs = 0;
+    int best_run = 0;
+};
 
 std::vector<DriverAssignment> schedule_deliveries(
     const Graph& g,
     const std::vector<Order>& orders,
     int num_drivers,
-    int depot_node
+    int depot_node,
+    const Deadline &deadline = Deadline::never(),   // on expiry routes stay as built so far
+    const ScheduleOptions &options = ScheduleOptions(),
+    ScheduleStats *stats = nullptr
 );
 
+// Sum of delivery times over the orders the routes deliver; delivered, if
+// given, counts the deliveries that are reachable at all.
 double compute_total_delivery_time(
     const Graph& g,
     const std::vector<DriverAssignment>& assignments,
-    const std::vector<Order>& orders
+    const std::vector<Order>& orders,
+    int* delivered = nullptr
 );
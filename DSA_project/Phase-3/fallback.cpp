@@ -0,0 +1,176 @@
+#include "fallback.hpp"
+#include <algorithm>
+#include <functional>
+using namespace std;
+
+void DistanceFallback::init(const Graph& g, const vector<int>& table_nodes, size_t capacity_bytes)
+{
+    dg = build_dense(g);
+    int n = dg.size();
+    rfirst.assign(n + 1, 0);
+    for (int v : dg.head) rfirst[v + 1]++;
+    for (int v = 0; v < n; v++) rfirst[v + 1] += rfirst[v];
+    rhead.resize(dg.head.size());
+    rweight.resize(dg.head.size());
+    vector<int> fill(rfirst.begin(), rfirst.end() - 1);
+    for (int u = 0; u < n; u++)
+        for (int k = dg.first[u]; k < dg.first[u + 1]; k++) {
+            int at = fill[dg.head[k]]++;
+            rhead[at] = u;
+            rweight[at] = dg.weight[k];
+        }
+
+    table_size = table_nodes.size();
+    dense_of.clear();
+    for (int id : table_nodes) {
+        auto it = dg.index.find(id);
+        dense_of.push_back(it == dg.index.end() ? -1 : it->second);
+    }
+    shard_bytes = capacity_bytes / SHARDS;
+}
+
+int DistanceFallback::target(int node)
+{
+    lock_guard<mutex> guard(targets_lock);
+    auto it = added.find(node);
+    if (it != added.end()) return it->second;
+    auto d = dg.index.find(node);
+    if (d == dg.index.end()) return -1;
+    dense_of.push_back(d->second);
+    return added[node] = dense_of.size() - 1;
+}
+
+int DistanceFallback::targets() const
+{
+    lock_guard<mutex> guard(targets_lock);
+    return dense_of.size();
+}
+
+float DistanceFallback::time(int a, int b)
+{
+    if (a == b) return 0.0f;
+    // the later target's row covers the earlier one, and it is past the table
+    int t = max(a, b);
+    shared_ptr<const Row> r = row(t);
+    return t == a ? r->out[b] : r->in[a];
+}
+
+// Dijkstra from s, forwards or over the reversed arcs, until every dense
+// node in goal is settled; out[i] is the time for goal[i].
+void DistanceFallback::search(int s, bool reverse, const vector<int>& goal, vector<float>& out) const
+{
+    const vector<int>& first = reverse ? rfirst : dg.first;
+    const vector<int>& head = reverse ? rhead : dg.head;
+    const vector<double>& weight = reverse ? rweight : dg.weight;
+    vector<double> dist(dg.size(), 1e18);
+    vector<char> wanted(dg.size(), 0);
+    int left = 0;
+    for (int v : goal)
+        if (v >= 0 && !wanted[v]) {
+            wanted[v] = 1;
+            left++;
+        }
+
+    using Item = pair<double,int>;
+    vector<Item> heap = {{0.0, s}};
+    auto cmp = greater<Item>();
+    dist[s] = 0.0;
+    while (!heap.empty() && left > 0) {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [d, u] = heap.back(); heap.pop_back();
+        if (d > dist[u]) continue;
+        if (wanted[u]) {
+            wanted[u] = 0;
+            left--;
+        }
+        for (int k = first[u]; k < first[u + 1]; k++) {
+            double nd = d + weight[k];
+            if (nd < dist[head[k]]) {
+                dist[head[k]] = nd;
+                heap.push_back({nd, head[k]});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+    out.resize(goal.size());
+    for (size_t i = 0; i < goal.size(); i++)
+        out[i] = goal[i] < 0 || dist[goal[i]] >= 1e18 ? 1e18f : (float)dist[goal[i]];
+}
+
+bool DistanceFallback::path(int from, int to, vector<int>& out) const
+{
+    auto s = dg.index.find(from), t = dg.index.find(to);
+    if (s == dg.index.end() || t == dg.index.end()) return false;
+    vector<double> dist(dg.size(), 1e18);
+    vector<int> parent(dg.size(), -1);
+    using Item = pair<double,int>;
+    vector<Item> heap = {{0.0, s->second}};
+    auto cmp = greater<Item>();
+    dist[s->second] = 0.0;
+    while (!heap.empty()) {
+        pop_heap(heap.begin(), heap.end(), cmp);
+        auto [d, u] = heap.back(); heap.pop_back();
+        if (d > dist[u]) continue;
+        if (u == t->second) break;
+        for (int k = dg.first[u]; k < dg.first[u + 1]; k++) {
+            double nd = d + dg.weight[k];
+            if (nd < dist[dg.head[k]]) {
+                dist[dg.head[k]] = nd;
+                parent[dg.head[k]] = u;
+                heap.push_back({nd, dg.head[k]});
+                push_heap(heap.begin(), heap.end(), cmp);
+            }
+        }
+    }
+    if (dist[t->second] >= 1e18) return false;
+    size_t at = out.size();
+    for (int v = t->second; v != s->second; v = parent[v]) out.push_back(dg.ids[v]);
+    reverse(out.begin() + at, out.end());
+    return true;
+}
+
+shared_ptr<const DistanceFallback::Row> DistanceFallback::row(int t)
+{
+    Shard& shard = shards[t % SHARDS];
+    {
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.rows.find(t);
+        if (it != shard.rows.end()) {
+            shard.recent.splice(shard.recent.begin(), shard.recent, it->second.second);
+            hit++;
+            return it->second.first;
+        }
+    }
+
+    // searched without the lock; two threads missing the same row both
+    // search and the second one's copy wins
+    miss++;
+    vector<int> goal;
+    {
+        lock_guard<mutex> guard(targets_lock);
+        goal = dense_of;
+    }
+    auto fresh = make_shared<Row>();
+    search(goal[t], false, goal, fresh->out);
+    search(goal[t], true, goal, fresh->in);
+    size_t bytes = 2 * goal.size() * sizeof(float);
+
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.rows.find(t);
+    if (it != shard.rows.end()) {
+        shard.bytes -= 2 * it->second.first->out.size() * sizeof(float);
+        it->second.first = fresh;
+        shard.recent.splice(shard.recent.begin(), shard.recent, it->second.second);
+    } else {
+        shard.recent.push_front(t);
+        shard.rows[t] = {fresh, shard.recent.begin()};
+    }
+    shard.bytes += bytes;
+    while (shard.bytes > shard_bytes && shard.rows.size() > 1) {
+        auto last = shard.rows.find(shard.recent.back());
+        shard.bytes -= 2 * last->second.first->out.size() * sizeof(float);
+        shard.rows.erase(last);
+        shard.recent.pop_back();
+    }
+    return fresh;
+}
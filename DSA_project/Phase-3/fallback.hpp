@@ -0,0 +1,68 @@
+#pragma once
+#include "graph.hpp"
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Travel times for nodes precomputed.bin does not cover. Every stop node
+// is a target, numbered like the table rows: the table's nodes first, then
+// the missing nodes in the order they turn up. A missing node's row is one
+// Dijkstra out of it and one into it over the loaded graph, stopped once
+// every target known at the time is settled, so a row also answers for
+// all targets added before it. Rows live in an LRU cache bounded in bytes
+// and split into shards with a lock each, so route builders running in
+// parallel rarely wait on each other; an evicted row is searched again.
+class DistanceFallback {
+public:
+    // table_nodes are the node ids of the table rows; capacity_bytes
+    // bounds the cached rows (at least one per shard).
+    void init(const Graph& g, const std::vector<int>& table_nodes, size_t capacity_bytes);
+
+    // Target of a node outside the table, added on first sight; -1 if the
+    // node is not in the graph.
+    int target(int node);
+    int targets() const;
+
+    // Seconds between two targets, one of them past the table; 1e18f if
+    // unreachable.
+    float time(int a, int b);
+
+    // Appends the road nodes after from on a shortest path to to, from one
+    // Dijkstra that keeps its parents; false if there is none.
+    bool path(int from, int to, std::vector<int>& out) const;
+
+    long hits() const { return hit; }
+    long misses() const { return miss; }
+
+private:
+    static constexpr int SHARDS = 16;
+
+    struct Row {
+        std::vector<float> out, in;     // from / to targets 0..size-1
+    };
+    struct Shard {
+        std::mutex lock;
+        std::list<int> recent;          // most recently used first
+        std::unordered_map<int, std::pair<std::shared_ptr<const Row>, std::list<int>::iterator>> rows;
+        size_t bytes = 0;
+    };
+
+    DenseGraph dg;
+    std::vector<int> rfirst, rhead;     // reversed arcs, for the search into a node
+    std::vector<double> rweight;
+    int table_size = 0;
+
+    mutable std::mutex targets_lock;    // guards the two below
+    std::vector<int> dense_of;          // dense index of each target, -1 if not in the graph
+    std::unordered_map<int, int> added; // node id -> target, past the table
+
+    Shard shards[SHARDS];
+    size_t shard_bytes = 0;
+    std::atomic<long> hit{0}, miss{0};
+
+    std::shared_ptr<const Row> row(int t);
+    void search(int s, bool reverse, const std::vector<int>& goal, std::vector<float>& out) const;
+};
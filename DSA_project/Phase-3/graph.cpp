@@ -2,6 +2,8 @@
 #include "nlohmann/json.hpp"
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 
 using json = nlohmann::json;
 using namespace std;
@@ -45,20 +47,167 @@ bool load_graph(const std::string& filename, Graph& g)
             e_forward.length = ed["length"];
             e_forward.average_time = ed.contains("average_time") ? 
                                      (double)ed["average_time"] : e_forward.length;
+            if (ed.contains("speed_profile"))
+                for (auto &sp : ed["speed_profile"]) e_forward.speed_profile.push_back(sp);
+            e_forward.road_type = ed.value("road_type", "");
 
             g.adj[u].push_back(e_forward);
             
             bool oneway = ed.contains("oneway") && ed["oneway"].get<bool>();
             
             if (!oneway) {
-                Edge e_backward;
+                Edge e_backward = e_forward;
                 e_backward.v = u;
-                e_backward.length = e_forward.length;
-                e_backward.average_time = e_forward.average_time;
                 g.adj[v].push_back(e_backward);
             }
         }
     }
 
     return true;
+}
+
+DenseGraph build_dense(const Graph& g)
+{
+    DenseGraph dg;
+    for (auto &p : g.nodes) dg.ids.push_back(p.first);
+    sort(dg.ids.begin(), dg.ids.end());
+    int n = dg.ids.size();
+    for (int i = 0; i < n; i++) dg.index[dg.ids[i]] = i;
+
+    dg.first.assign(n + 1, 0);
+    for (int i = 0; i < n; i++) {
+        auto it = g.adj.find(dg.ids[i]);
+        int deg = 0;
+        if (it != g.adj.end())
+            for (auto &e : it->second) deg += dg.index.count(e.v);
+        dg.first[i + 1] = dg.first[i] + deg;
+    }
+
+    dg.head.resize(dg.first[n]);
+    dg.weight.resize(dg.first[n]);
+    dg.edge.resize(dg.first[n]);
+    for (int i = 0; i < n; i++) {
+        auto it = g.adj.find(dg.ids[i]);
+        if (it == g.adj.end()) continue;
+        int k = dg.first[i];
+        for (auto &e : it->second) {
+            auto iv = dg.index.find(e.v);
+            if (iv == dg.index.end()) continue;
+            dg.head[k] = iv->second;
+            dg.weight[k] = e.average_time;
+            dg.edge[k] = &e;
+            k++;
+        }
+    }
+    return dg;
+}
+
+double profile_time(const Edge& e, double start)
+{
+    if (e.speed_profile.empty()) return e.average_time;
+    double remaining = e.length, now = start, total = 0.0;
+    while (remaining > 1e-6) {
+        int slot = (long long)floor(now / SLOT_SECONDS) % e.speed_profile.size();
+        double left = SLOT_SECONDS - fmod(now, SLOT_SECONDS);
+        double speed = e.speed_profile[slot];
+        if (speed <= 1e-6) speed = e.length / e.average_time;   // bad speed: use the average
+        if (speed * left >= remaining - 1e-6) {
+            total += remaining / speed;
+            break;
+        }
+        total += left;
+        remaining -= speed * left;
+        now += left;
+    }
+    return total;
+}
+
+SpeedClasses speed_classes(const DenseGraph& dg)
+{
+    SpeedClasses sc;
+    int arcs = dg.head.size();
+    sc.arc_class.assign(arcs, -1);
+
+    // road types by the static time they carry, busiest first
+    unordered_map<string, double> carried;
+    for (int k = 0; k < arcs; k++)
+        if (!dg.edge[k]->speed_profile.empty()) carried[dg.edge[k]->road_type] += dg.weight[k];
+    if (carried.empty()) return sc;
+    vector<pair<double, string>> types;
+    for (auto &t : carried) types.push_back({-t.second, t.first});
+    sort(types.begin(), types.end());
+    sc.count = min<int>(types.size(), SpeedClasses::MAX_CLASSES);
+    unordered_map<string, int> class_of;
+    for (int c = 0; c < (int)types.size(); c++)
+        class_of[types[c].second] = min(c, sc.count - 1);
+
+    vector<double> slot_time((size_t)sc.count * SPEED_SLOTS, 0.0), total(sc.count, 0.0);
+    sc.mean_time = dg.weight;
+    for (int k = 0; k < arcs; k++) {
+        const Edge &e = *dg.edge[k];
+        if (e.speed_profile.empty()) continue;
+        int c = class_of[e.road_type];
+        sc.arc_class[k] = c;
+        double sum = 0.0;
+        for (int t = 0; t < SPEED_SLOTS; t++) {
+            double time = profile_time(e, t * SLOT_SECONDS);
+            slot_time[(size_t)c * SPEED_SLOTS + t] += time;
+            sum += time;
+        }
+        sc.mean_time[k] = sum / SPEED_SLOTS;
+        total[c] += sc.mean_time[k];
+    }
+    sc.slowdown.resize(slot_time.size());
+    for (int c = 0; c < sc.count; c++)
+        for (int t = 0; t < SPEED_SLOTS; t++) {
+            size_t i = (size_t)c * SPEED_SLOTS + t;
+            sc.slowdown[i] = total[c] > 0.0 ? slot_time[i] / total[c] - 1.0 : 0.0;
+        }
+    return sc;
+}
+
+uint64_t graph_fingerprint(const Graph& g)
+{
+    uint64_t h = 1469598103934665603ULL;
+    auto mix = [&](const void *p, size_t n) {
+        const unsigned char *b = (const unsigned char *)p;
+        for (size_t i = 0; i < n; i++) { h ^= b[i]; h *= 1099511628211ULL; }
+    };
+
+    vector<int> ids;
+    for (auto &p : g.nodes) ids.push_back(p.first);
+    sort(ids.begin(), ids.end());
+    uint64_t n = ids.size();
+    mix(&n, sizeof(n));
+
+    vector<pair<int, const Edge*>> arcs;
+    for (int id : ids) {
+        const Node &nd = g.nodes.at(id);
+        mix(&nd.id, sizeof(nd.id));
+        mix(&nd.lat, sizeof(nd.lat));
+        mix(&nd.lon, sizeof(nd.lon));
+
+        arcs.clear();
+        auto it = g.adj.find(id);
+        if (it != g.adj.end())
+            for (auto &e : it->second) arcs.push_back({e.v, &e});
+        sort(arcs.begin(), arcs.end(), [](auto &a, auto &b) {
+            return a.first != b.first ? a.first < b.first
+                                      : a.second->average_time < b.second->average_time;
+        });
+        uint64_t deg = arcs.size();
+        mix(&deg, sizeof(deg));
+        for (auto &a : arcs) {
+            mix(&a.first, sizeof(a.first));
+            mix(&a.second->average_time, sizeof(double));
+            // profiles only count when present, so graphs without any
+            // keep their old fingerprint
+            const vector<double> &sp = a.second->speed_profile;
+            if (!sp.empty()) {
+                mix(sp.data(), sp.size() * sizeof(double));
+                mix(a.second->road_type.data(), a.second->road_type.size());
+            }
+        }
+    }
+    return h;
 }
\ No newline at end of file
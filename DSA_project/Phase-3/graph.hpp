@@ -1,8 +1,13 @@
 #pragma once
+#include <cstdint>
 #include <unordered_map>
 #include <vector>
 #include <string>
 
+// Speed profiles cover a day in 15-minute slots.
+constexpr int SPEED_SLOTS = 96;
+constexpr double SLOT_SECONDS = 900.0;
+
 struct Node {
     int id;
     double lat;
@@ -13,6 +18,8 @@ struct Edge {
     int v;
     double length;
     double average_time;
+    std::vector<double> speed_profile;     // m/s per 15-minute slot of the day, may be empty
+    std::string road_type;
 };
 
 struct Graph {
@@ -20,4 +27,42 @@ struct Graph {
     std::unordered_map<int, std::vector<Edge>> adj;
 };
 
+// Compact CSR copy of a Graph over dense node indices (ids in ascending
+// order), for searches that want flat arrays instead of hash maps.
+struct DenseGraph {
+    std::vector<int> ids;                  // dense index -> node id
+    std::unordered_map<int, int> index;    // node id -> dense index
+    std::vector<int> first;                // arcs of u are [first[u], first[u+1])
+    std::vector<int> head;
+    std::vector<double> weight;            // average_time
+    std::vector<const Edge*> edge;         // the Graph edge behind each arc
+
+    int size() const { return ids.size(); }
+};
+
+// Edges with a speed profile grouped by road type. An edge's profile
+// splits into its daily mean time (profile_time from the start of each
+// slot, averaged) and its class's shape: the class's total time in each
+// slot over its total mean time. A path's time at a given slot is then its mean time
+// with each class's part scaled by that class's shape, exact when a
+// class's edges share a profile shape.
+struct SpeedClasses {
+    static constexpr int MAX_CLASSES = 8;  // more road types share the last class
+
+    int count = 0;
+    std::vector<float> slowdown;           // count x SPEED_SLOTS, shape minus one
+    std::vector<int> arc_class;            // per DenseGraph arc, -1 without a profile
+    std::vector<double> mean_time;         // per DenseGraph arc, average_time without a profile
+};
+
 bool load_graph(const std::string& filename, Graph& g);
+DenseGraph build_dense(const Graph& g);
+
+// Seconds to traverse e entering it start seconds into the day, walking its
+// speed profile slot by slot as Phase-1 does; average_time without one.
+double profile_time(const Edge& e, double start);
+SpeedClasses speed_classes(const DenseGraph& dg);
+
+// FNV-1a over nodes and arcs (with their speed profiles) in id order,
+// enough to tell graphs apart.
+uint64_t graph_fingerprint(const Graph& g);
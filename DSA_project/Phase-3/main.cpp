@@ -10,16 +10,151 @@
 #include <limits>
 #include "graph.hpp"
 #include "delivery.hpp"
+#include "stream.hpp"
 #include "nlohmann/json.hpp"
 
 using namespace std;
 using json = nlohmann::json;
 
+// Optional per-order fields: "load" (default 1) and "pickup_window" /
+// "dropoff_window" as [open, close] in seconds.
+static Order parse_order(const json& o)
+{
+    Order order;
+    order.order_id = o["order_id"];
+    order.pickup = o["pickup"];
+    order.dropoff = o["dropoff"];
+    order.load = o.value("load", order.load);
+    if (o.contains("pickup_window")) {
+        order.pickup_open = o["pickup_window"][0];
+        order.pickup_close = o["pickup_window"][1];
+    }
+    if (o.contains("dropoff_window")) {
+        order.dropoff_open = o["dropoff_window"][0];
+        order.dropoff_close = o["dropoff_window"][1];
+    }
+    return order;
+}
+
+// With road_paths, "road_path" lists every road node the driver passes
+// (missing if a leg has no path).
+static json assignment_json(const DriverAssignment& a, bool road_paths)
+{
+    json assignment;
+    assignment["driver_id"] = a.driver_id;
+    assignment["route"] = a.route;
+    assignment["order_ids"] = a.order_ids;
+    if (road_paths) {
+        vector<int> path = road_path(a.route);
+        if (!path.empty()) assignment["road_path"] = path;
+    }
+    return assignment;
+}
+
+static bool write_output(const string& file, const vector<DriverAssignment>& assignments, double total_time,
+                         bool road_paths, ostream& log)
+{
+    json out;
+    out["assignments"] = json::array();
+    
+    for (auto& a : assignments) {
+        out["assignments"].push_back(assignment_json(a, road_paths));
+    }
+    
+    out["metrics"] = {
+        {"total_delivery_time", total_time}
+    };
+
+    ofstream out_file(file);
+    if (!out_file) {
+        cerr << "Failed to open output file " << file << "\n";
+        return false;
+    }
+    
+    out_file << out.dump(2);
+    out_file.close();
+    
+    log << "Output written to " << file << "\n";
+    return true;
+}
+
+// How much the run leaned on searches for nodes precomputed.bin lacks.
+static void report_fallback(ostream& out)
+{
+    FallbackStats fs = fallback_stats();
+    if (fs.nodes == 0) return;
+    out << "Fallback distances: " << fs.hits << " cache hits, " << fs.misses << " searches ("
+        << fs.nodes << " nodes outside precomputed.bin)\n";
+}
+
+// Stream mode: one order per line on stdin as JSON, each answered with the
+// updated route of the driver it went to. Orders in the queries file only
+// size the dispatcher; nodes of streamed orders that are not in
+// precomputed.bin are searched for on demand. Background repairs print their
+// improved routes with "repaired": true. At end of input the final
+// schedule is written like a batch run.
+static int run_stream(const Graph& g, const json& q, int num_drivers, int depot, int expected_orders,
+                      const string& output)
+{
+    int capacity = q["fleet"].value("capacity", 0);
+    bool road_paths = q.value("road_paths", false);
+    Dispatcher dispatcher(num_drivers, depot, expected_orders, capacity, [&](const DriverAssignment& a, int order_id) {
+        json line = assignment_json(a, road_paths);
+        if (order_id >= 0) line["order_id"] = order_id;
+        else line["repaired"] = true;
+        cout << line.dump() << endl;
+    });
+    double repair_ms = q.value("stream_repair_ms", 5.0);
+    if (repair_ms > 0) dispatcher.start_repair(repair_ms);
+
+    long inserted = 0;
+    double total_us = 0.0, worst_us = 0.0;
+    string text;
+    while (getline(cin, text)) {
+        if (text.find_first_not_of(" \t\r") == string::npos) continue;
+        Order order;
+        try {
+            order = parse_order(json::parse(text));
+        } catch (const exception& e) {
+            cerr << "Skipping bad order line: " << e.what() << "\n";
+            continue;
+        }
+
+        string error;
+        double us = 0.0;
+        int driver = dispatcher.insert(order, error, &us);
+        if (driver < 0) {
+            cout << json{{"order_id", order.order_id}, {"error", error}}.dump() << endl;
+            continue;
+        }
+        inserted++;
+        total_us += us;
+        worst_us = max(worst_us, us);
+    }
+    dispatcher.stop_repair();
+
+    auto assignments = dispatcher.assignments();
+    double total_time = compute_total_delivery_time(g, assignments, dispatcher.orders());
+    cerr << "Streamed " << inserted << " orders, insert latency mean "
+         << (inserted ? total_us / inserted : 0.0) << " us, max " << worst_us << " us, "
+         << dispatcher.repairs() << " repairs\n";
+    cerr << "Total delivery time: " << total_time << " seconds\n";
+    report_fallback(cerr);
+    return write_output(output, assignments, total_time, road_paths, cerr) ? 0 : 1;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 4) {
-        cerr << "Usage: ./phase3 graph.json queries.json output.json\n";
+    bool stream = argc > 1 && string(argv[1]) == "--stream";
+    if (stream) {
+        argv++;
+        argc--;
+    }
+    if (argc != 4 && argc != 5) {
+        cerr << "Usage: ./phase3 [--stream] graph.json queries.json output.json [precomputed.bin]\n";
         return 1;
     }
+    // stream mode keeps stdout for its JSON lines
+    ostream& log = stream ? cerr : cout;
 
     Graph g;
     if (!load_graph(argv[1], g)) {
@@ -27,14 +162,7 @@ int main(int argc, char** argv) {
         return 1;
     }
     
-    cout << "Loaded graph with " << g.nodes.size() << " nodes\n";
-
-    if (!load_precomputed("precomputed.bin")) {
-        cerr << "Failed to load precomputed data. Run ./precompute first!\n";
-        return 1;
-    }
-    
-    cout << "Loaded precomputed data\n";
+    log << "Loaded graph with " << g.nodes.size() << " nodes\n";
 
     ifstream f(argv[2]);
     if (!f) {
@@ -51,64 +179,86 @@ int main(int argc, char** argv) {
     }
 
     vector<Order> orders;
-    if (!q.contains("orders")) {
+    if (!q.contains("orders") && !stream) {
         cerr << "No orders found in queries\n";
         return 1;
     }
     
-    for (auto& o : q["orders"]) {
-        Order order;
-        order.order_id = o["order_id"];
-        order.pickup = o["pickup"];
-        order.dropoff = o["dropoff"];
-        orders.push_back(order);
+    for (auto& o : q.value("orders", json::array())) {
+        orders.push_back(parse_order(o));
     }
     
-    cout << "Loaded " << orders.size() << " orders\n";
+    log << "Loaded " << orders.size() << " orders\n";
 
     int num_drivers = q["fleet"]["num_delivery_guys"];
     int depot = q["fleet"]["depot_node"];
     
-    cout << "Fleet: " << num_drivers << " drivers, depot at node " << depot << "\n";
+    log << "Fleet: " << num_drivers << " drivers, depot at node " << depot << "\n";
+
+    string precomputed_file = argc == 5 ? argv[4] : "precomputed.bin";
+    // Optional memory for the rows of nodes precomputed.bin lacks
+    size_t cache_bytes = q.value("fallback_cache_mb", 64.0) * (1 << 20);
+    // Optional full checksum of the file, for debugging a suspect one
+    bool verify = q.value("verify_precomputed", false);
+    if (!load_precomputed(precomputed_file, g, orders, depot, cache_bytes, verify)) {
+        cerr << "Failed to load precomputed data. Run ./precompute first!\n";
+        return 1;
+    }
+
+    log << "Loaded precomputed data from " << precomputed_file << "\n";
+    if (q.value("road_paths", false) && !has_road_paths())
+        cerr << precomputed_file << " has no road paths; rerun ./precompute with this queries file\n";
+
+    if (stream) return run_stream(g, q, num_drivers, depot, orders.size(), argv[3]);
+
+    // Optional time of day the drivers leave, in seconds; prices legs by
+    // the speed profiles
+    double departure = q["fleet"].value("departure_time", -1.0);
+    if (departure >= 0.0) {
+        if (use_time_profiles(departure))
+            cout << "Time-dependent travel times from " << departure << " s\n";
+        else
+            cerr << precomputed_file << " has no speed profiles; using static travel times\n";
+    }
+
+    // Optional scheduling budget; route improvement stops when it expires
+    double budget_ms = q.value("time_budget_ms", -1.0);
+    Deadline::calibrate();
+    Deadline deadline = budget_ms > 0 ? Deadline(budget_ms) : Deadline();
 
     auto start_time = chrono::high_resolution_clock::now();
     
-    auto assignments = schedule_deliveries(g, orders, num_drivers, depot);
+    // Optional exact-route and ALNS settings; ALNS only runs when given a
+    // budget or an iteration count, and a fixed count makes runs repeatable
+    ScheduleOptions options;
+    options.alns_budget_ms = q.value("alns_budget_ms", options.alns_budget_ms);
+    options.alns_iterations = q.value("alns_iterations", options.alns_iterations);
+    options.seed = q.value("seed", options.seed);
+    options.threads = q.value("threads", options.threads);
+    options.portfolio = q.value("portfolio", options.portfolio);
+    options.exact_max_orders = q.value("exact_max_orders", options.exact_max_orders);
+    options.capacity = q["fleet"].value("capacity", options.capacity);
+    ScheduleStats stats;
+
+    auto assignments = schedule_deliveries(g, orders, num_drivers, depot, deadline, options, &stats);
     
     auto end_time = chrono::high_resolution_clock::now();
     auto duration = chrono::duration_cast<chrono::milliseconds>(end_time - start_time);
     
     cout << "Scheduling completed in " << duration.count() << " ms\n";
+    cout << "Heuristic total: " << stats.heuristic_total << " seconds";
+    if (stats.portfolio_runs > 0)
+        cout << ", after ALNS (best of " << stats.portfolio_runs << " runs, run " << stats.best_run << ", "
+             << stats.alns_iterations << " iterations): " << stats.final_total << " seconds";
+    cout << "\n";
 
-    double total_time = compute_total_delivery_time(g, assignments, orders);
+    int delivered = 0;
+    double total_time = compute_total_delivery_time(g, assignments, orders, &delivered);
     
     cout << "Total delivery time: " << total_time << " seconds\n";
+    if (delivered < (int)orders.size())
+        cout << "Delivered " << delivered << " of " << orders.size() << " orders\n";
+    report_fallback(cout);
 
-    json out;
-    out["assignments"] = json::array();
-    
-    for (auto& a : assignments) {
-        json assignment;
-        assignment["driver_id"] = a.driver_id;
-        assignment["route"] = a.route;
-        assignment["order_ids"] = a.order_ids;
-        out["assignments"].push_back(assignment);
-    }
-    
-    out["metrics"] = {
-        {"total_delivery_time", total_time}
-    };
-
-    ofstream out_file(argv[3]);
-    if (!out_file) {
-        cerr << "Failed to open output file " << argv[3] << "\n";
-        return 1;
-    }
-    
-    out_file << out.dump(2);
-    out_file.close();
-    
-    cout << "Output written to " << argv[3] << "\n";
-
-    return 0;
+    return write_output(argv[3], assignments, total_time, q.value("road_paths", false), cout) ? 0 : 1;
 }
\ No newline at end of file
@@ -8,41 +8,17 @@
 #include <cmath>
 #include <algorithm>
 #include <limits>
+#include <atomic>
+#include <thread>
 #include "graph.hpp"
+#include "ch.hpp"
+#include "precomputed.hpp"
 #include "nlohmann/json.hpp"
 using namespace std;
 using json = nlohmann::json;
 
 static const double INF = 1e18;
 
-unordered_map<int,double> dijkstra_all(const Graph& g, int s)
-{
-    unordered_map<int,double> dist;
-    for (auto &p : g.nodes) dist[p.first] = INF;
-    dist[s] = 0.0;
-
-    using State = pair<double,int>;
-    priority_queue<State, vector<State>, greater<State>> pq;
-    pq.push({0.0, s});
-
-    while (!pq.empty()) {
-        auto [d,u] = pq.top(); pq.pop();
-        if (d > dist[u]) continue;
-
-        auto it = g.adj.find(u);
-        if (it == g.adj.end()) continue;
-
-        for (const auto &e : it->second) {
-            double nd = d + e.average_time;
-            if (nd < dist[e.v]) {
-                dist[e.v] = nd;
-                pq.push({nd, e.v});
-            }
-        }
-    }
-    return dist;
-}
-
 int main(int argc, char** argv) {
     if (argc != 4) {
         cerr << "Usage: ./precompute graph.json queries.json precomputed.bin\n";
@@ -65,6 +41,10 @@ int main(int argc, char** argv) {
     f >> q;
 
     int depot = q["fleet"]["depot_node"];
+    if (g.nodes.find(depot) == g.nodes.end()) {
+        cerr << "Error: Depot node " << depot << " not found in graph!\n";
+        return 1;
+    }
 
     unordered_set<int> important_set;
     important_set.insert(depot);
@@ -73,79 +53,221 @@ int main(int argc, char** argv) {
         important_set.insert(o["dropoff"].get<int>());
     }
 
-    vector<int> all_node_ids;
-    for (auto &p : g.nodes) {
-        all_node_ids.push_back(p.first);
-    }
-    sort(all_node_ids.begin(), all_node_ids.end());
-    int N = all_node_ids.size();
-
-    unordered_map<int,int> node_to_col;
-    for (int i = 0; i < N; ++i) {
-        node_to_col[all_node_ids[i]] = i;
-    }
+    DenseGraph dg = build_dense(g);
+    int N = dg.size();
 
     vector<int> important_nodes(important_set.begin(), important_set.end());
     sort(important_nodes.begin(), important_nodes.end());
     int M = important_nodes.size();
 
-    cout << "Computing distances for " << M << " important nodes to " << N << " total nodes...\n";
+    cout << "Computing distances between " << M << " important nodes (" << N << " total nodes)...\n";
 
-    vector<vector<double>> dist_table(M, vector<double>(N, INF));
+    CH ch = build_ch(dg);
+    cout << "Contraction hierarchy: " << ch.up_head.size() << " upward and "
+         << ch.down_tail.size() << " downward arcs\n";
 
-    for (int i = 0; i < M; ++i) {
-        auto distances = dijkstra_all(g, important_nodes[i]);
-        
-        for (auto &[node_id, dist] : distances) {
-            if (node_to_col.count(node_id)) {
-                dist_table[i][node_to_col[node_id]] = dist;
+    // Important nodes missing from the graph keep INF rows and columns.
+    vector<int> dense_ids;
+    vector<int> dense_rows;
+    for (int i = 0; i < M; i++) {
+        auto it = dg.index.find(important_nodes[i]);
+        if (it == dg.index.end()) continue;
+        dense_ids.push_back(it->second);
+        dense_rows.push_back(i);
+    }
+    int K = dense_ids.size();
+    int num_threads = max(1u, thread::hardware_concurrency());
+
+    // Speed profiles add each path's mean time on every road class and in
+    // total, carried through either search below as side labels.
+    SpeedClasses classes = speed_classes(dg);
+    int C = classes.count, W = C + 1;
+    if (C > 0) {
+        vector<float> arc_extra(dg.head.size() * W, 0.0f);
+        for (size_t k = 0; k < dg.head.size(); k++) {
+            if (classes.arc_class[k] >= 0) arc_extra[k * W + classes.arc_class[k]] = classes.mean_time[k];
+            arc_extra[k * W + C] = classes.mean_time[k];
+        }
+        attach_extras(ch, dg, arc_extra, W);
+        cout << "Speed profiles: " << C << " road classes\n";
+    }
+
+    // Only the M x M block is kept. Bucket queries cost two upward searches
+    // per important node; once important nodes are a sizeable share of the
+    // graph, full PHAST rows are cheaper and we just keep their columns.
+    // Road paths (queries key "road_paths") need the bucket searches'
+    // trees, so they always take that branch.
+    bool keep_paths = q.value("road_paths", false);
+    vector<float> dist_table((size_t)M * M, (float)INF);
+    vector<float> block((size_t)K * K);
+    MeetingPaths paths;
+    vector<float> level_block(C > 0 ? (size_t)K * K : 0, 1.0f);
+    vector<uint8_t> share_block((size_t)K * K * C, 0);
+    // path level and class shares from the side labels of one pair
+    auto profile_pair = [&](size_t at, double d, const float* on) {
+        if (d <= 0.0 || d >= INF || on[C] <= 0.0f) return;
+        level_block[at] = on[C] / d;
+        for (int c = 0; c < C; c++)
+            share_block[at * C + c] = (uint8_t)lround(min(1.0f, on[c] / on[C]) * 255.0f);
+    };
+    if (!keep_paths && (long long)K * 16 >= N) {
+        int num_batches = (K + PHAST_LANES - 1) / PHAST_LANES;
+        atomic<int> next_batch{0};
+        auto worker = [&]() {
+            PhastWorkspace ws;
+            vector<double> rows_buf((size_t)PHAST_LANES * N);
+            vector<float> extra_buf((size_t)PHAST_LANES * N * W);
+            double* rows[PHAST_LANES];
+            float* extra_rows[PHAST_LANES];
+            for (int l = 0; l < PHAST_LANES; l++) {
+                rows[l] = &rows_buf[(size_t)l * N];
+                extra_rows[l] = &extra_buf[(size_t)l * N * W];
             }
+            for (int b = next_batch++; b < num_batches; b = next_batch++) {
+                int lo = b * PHAST_LANES, count = min(K, lo + PHAST_LANES) - lo;
+                phast_rows(ch, &dense_ids[lo], count, rows, ws, C > 0 ? extra_rows : nullptr);
+                for (int l = 0; l < count; l++)
+                    for (int j = 0; j < K; j++) {
+                        double d = rows[l][dense_ids[j]];
+                        block[(size_t)(lo + l) * K + j] = (float)d;
+                        if (C > 0) profile_pair((size_t)(lo + l) * K + j, d, &extra_rows[l][(size_t)dense_ids[j] * W]);
+                    }
+            }
+        };
+        int threads = min(num_threads, max(1, num_batches));
+        vector<thread> pool;
+        for (int t = 1; t < threads; t++) pool.emplace_back(worker);
+        worker();
+        for (auto& th : pool) th.join();
+        cout << "Distances via PHAST sweeps\n";
+    } else {
+        vector<float> extra_block(C > 0 ? (size_t)K * K * W : 0);
+        many_to_many(ch, dense_ids, dense_ids, block.data(), num_threads, keep_paths ? &paths : nullptr,
+                     C > 0 ? extra_block.data() : nullptr);
+        for (size_t at = 0; at < (size_t)K * K && C > 0; at++)
+            profile_pair(at, block[at], &extra_block[at * W]);
+        cout << "Distances via bucket many-to-many\n";
+    }
+    vector<float> level(C > 0 ? (size_t)M * M : 0, 1.0f);
+    vector<uint8_t> share((size_t)M * M * C, 0);
+    for (int a = 0; a < K; a++)
+        for (int b = 0; b < K; b++) {
+            size_t from = (size_t)a * K + b, to = (size_t)dense_rows[a] * M + dense_rows[b];
+            dist_table[to] = block[from];
+            if (C == 0) continue;
+            level[to] = level_block[from];
+            copy_n(&share_block[from * C], C, &share[to * C]);
         }
-        
-        if ((i + 1) % 10 == 0) {
-            cout << "Processed " << (i + 1) << "/" << M << " nodes\n";
+
+    // For road paths: search trees per row, those of nodes missing from
+    // the graph empty, and the meeting entries of every pair. A tree keeps only the entries
+    // on the way to some meeting entry, which is a small part of the
+    // search space.
+    vector<int64_t> tree_first(2 * M + 1, 0);
+    vector<TreeEntry> trees;
+    vector<int32_t> meet;
+    vector<int32_t> ch_nodes;
+    vector<UnpackArc> unpack_up, unpack_down;
+    if (keep_paths) {
+        meet.assign((size_t)M * M * 2, -1);
+        vector<vector<int32_t>> keep(2 * K);
+        for (int a = 0; a < K; a++) {
+            keep[a].assign(paths.forward[a].size(), -1);
+            keep[K + a].assign(paths.backward[a].size(), -1);
         }
-    }
+        auto mark = [](const vector<TreeEntry>& tree, vector<int32_t>& kept, int e) {
+            for (; e >= 0 && kept[e] < 0; e = tree[e].parent) kept[e] = 0;
+        };
+        for (int a = 0; a < K; a++)
+            for (int b = 0; b < K; b++) {
+                const int32_t* m = &paths.meet[((size_t)a * K + b) * 2];
+                if (m[0] < 0) continue;
+                mark(paths.forward[a], keep[a], m[0]);
+                mark(paths.backward[b], keep[K + b], m[1]);
+            }
 
-    vector<double> radius(N);
-    vector<double> angle(N);
-    
-    if (g.nodes.find(depot) == g.nodes.end()) {
-        cerr << "Error: Depot node " << depot << " not found in graph!\n";
-        return 1;
+        vector<int> tree_of(2 * M, -1);
+        for (int a = 0; a < K; a++) {
+            tree_of[dense_rows[a]] = a;
+            tree_of[M + dense_rows[a]] = K + a;
+        }
+        for (int r = 0; r < 2 * M; r++) {
+            int t = tree_of[r];
+            if (t >= 0) {
+                const vector<TreeEntry>& tree = t < K ? paths.forward[t] : paths.backward[t - K];
+                // parents come before their children, so they are renumbered first
+                int32_t next = 0;
+                for (size_t e = 0; e < tree.size(); e++) {
+                    if (keep[t][e] < 0) continue;
+                    keep[t][e] = next++;
+                    trees.push_back({tree[e].parent < 0 ? -1 : keep[t][tree[e].parent], tree[e].arc});
+                }
+            }
+            tree_first[r + 1] = trees.size();
+        }
+        for (int a = 0; a < K; a++)
+            for (int b = 0; b < K; b++) {
+                const int32_t* m = &paths.meet[((size_t)a * K + b) * 2];
+                if (m[0] < 0) continue;
+                int32_t* out = &meet[((size_t)dense_rows[a] * M + dense_rows[b]) * 2];
+                out[0] = keep[a][m[0]];
+                out[1] = keep[K + b][m[1]];
+            }
+
+        ch_nodes.resize(N);
+        for (int p = 0; p < N; p++) ch_nodes[p] = dg.ids[ch.node_at[p]];
+        unpack_arcs(ch, unpack_up, unpack_down);
+        cout << "Road paths: " << trees.size() << " search tree entries\n";
     }
-    
+
+    vector<double> radius(M);
+    vector<double> angle(M);
     auto &depot_node = g.nodes.at(depot);
 
-    for (int i = 0; i < N; ++i) {
-        auto &node = g.nodes.at(all_node_ids[i]);
-        double dx = node.lat - depot_node.lat;
-        double dy = node.lon - depot_node.lon;
+    for (int i = 0; i < M; ++i) {
+        auto it = g.nodes.find(important_nodes[i]);
+        if (it == g.nodes.end()) continue;
+        double dx = it->second.lat - depot_node.lat;
+        double dy = it->second.lon - depot_node.lon;
         radius[i] = sqrt(dx * dx + dy * dy);
         angle[i] = atan2(dy, dx);
     }
 
-    ofstream out(argv[3], ios::binary);
-    if (!out) {
-        cerr << "Failed to open output file\n";
+    PrecomputedHeader header{};
+    header.dtype = DTYPE_F32;
+    header.graph_hash = graph_fingerprint(g);
+    header.nodes_hash = important_nodes_hash(important_nodes);
+    header.m = M;
+
+    PrecomputedWriter writer;
+    writer.add(SEC_IDS, important_nodes.data(), M * sizeof(int32_t));
+    writer.add(SEC_DIST, dist_table.data(), (size_t)M * M * sizeof(float));
+    writer.add(SEC_RADIUS, radius.data(), M * sizeof(double));
+    writer.add(SEC_ANGLE, angle.data(), M * sizeof(double));
+    if (C > 0) {
+        writer.add(SEC_SLOWDOWN, classes.slowdown.data(), classes.slowdown.size() * sizeof(float));
+        writer.add(SEC_LEVEL, level.data(), level.size() * sizeof(float));
+        writer.add(SEC_SHARE, share.data(), share.size());
+    }
+    if (keep_paths) {
+        writer.add(SEC_CH_NODES, ch_nodes.data(), N * sizeof(int32_t));
+        writer.add(SEC_UNPACK_UP, unpack_up.data(), unpack_up.size() * sizeof(UnpackArc));
+        writer.add(SEC_UNPACK_DOWN, unpack_down.data(), unpack_down.size() * sizeof(UnpackArc));
+        writer.add(SEC_TREE_FIRST, tree_first.data(), tree_first.size() * sizeof(int64_t));
+        writer.add(SEC_TREES, trees.data(), trees.size() * sizeof(TreeEntry));
+        writer.add(SEC_MEET, meet.data(), meet.size() * sizeof(int32_t));
+    }
+    if (!writer.write(argv[3], header)) {
+        cerr << "Failed to write output file\n";
         return 1;
     }
-
-    int32_t M_int = M, N_int = N;
-    
-    out.write((char*)&M_int, sizeof(int32_t));
-    out.write((char*)&N_int, sizeof(int32_t));
-    
-    out.write((char*)important_nodes.data(), M * sizeof(int32_t));
-    out.write((char*)all_node_ids.data(), N * sizeof(int32_t));
-    
-    for (int i = 0; i < M; i++) {
-        out.write((char*)dist_table[i].data(), N * sizeof(double));
+    // phase3 only checks the section table, so read the payloads back once here
+    PrecomputedFile written;
+    string error;
+    if (!written.open(argv[3], error, true)) {
+        cerr << error << "\n";
+        return 1;
     }
-    
-    out.write((char*)radius.data(), N * sizeof(double));
-    out.write((char*)angle.data(), N * sizeof(double));
-    out.close();
 
     cout << "Precomputation complete!\n";
     cout << "Important nodes: " << M << "\n";
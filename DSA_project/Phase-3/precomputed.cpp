@@ -0,0 +1,181 @@
+#include "precomputed.hpp"
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+
+void Checksum::add(const void* data, size_t n)
+{
+    const unsigned char* b = (const unsigned char*)data;
+    // finish a word left over from the previous call
+    while (n > 0 && pending_bytes > 0) {
+        pending |= (uint64_t)*b++ << (8 * pending_bytes++);
+        n--;
+        if (pending_bytes == 8) {
+            h = (h ^ pending) * FNV_PRIME;
+            pending = 0;
+            pending_bytes = 0;
+        }
+    }
+    for (; n >= 8; b += 8, n -= 8) {
+        uint64_t w;
+        memcpy(&w, b, 8);
+        h = (h ^ w) * FNV_PRIME;
+    }
+    while (n > 0) {
+        pending |= (uint64_t)*b++ << (8 * pending_bytes++);
+        n--;
+    }
+}
+
+uint64_t Checksum::value() const
+{
+    return pending_bytes > 0 ? (h ^ pending ^ ((uint64_t)pending_bytes << 56)) * FNV_PRIME : h;
+}
+
+uint64_t important_nodes_hash(const vector<int>& sorted_ids)
+{
+    Checksum c;
+    uint64_t m = sorted_ids.size();
+    c.add(&m, sizeof(m));
+    for (int id : sorted_ids) {
+        int32_t v = id;
+        c.add(&v, sizeof(v));
+    }
+    return c.value();
+}
+
+static uint64_t align_up(uint64_t x)
+{
+    return (x + PRECOMPUTED_ALIGN - 1) / PRECOMPUTED_ALIGN * PRECOMPUTED_ALIGN;
+}
+
+void PrecomputedWriter::add(uint32_t tag, const void* data, size_t bytes)
+{
+    sections.push_back({tag, data, bytes});
+}
+
+bool PrecomputedWriter::write(const string& path, PrecomputedHeader header) const
+{
+    vector<PrecomputedSection> dir;
+    uint64_t offset = align_up(sizeof(PrecomputedHeader) + sections.size() * sizeof(PrecomputedSection));
+    for (auto& s : sections) {
+        dir.push_back({s.tag, 0, offset, s.bytes});
+        offset = align_up(offset + s.bytes);
+    }
+
+    // Everything after the header, in file order; run once for the
+    // checksum and once more for the actual write.
+    static const char zeros[PRECOMPUTED_ALIGN] = {};
+    auto emit_body = [&](const function<void(const void*, size_t)>& sink) {
+        uint64_t at = sizeof(PrecomputedHeader);
+        sink(dir.data(), dir.size() * sizeof(PrecomputedSection));
+        at += dir.size() * sizeof(PrecomputedSection);
+        for (size_t i = 0; i < sections.size(); i++) {
+            sink(zeros, dir[i].offset - at);
+            sink(sections[i].data, sections[i].bytes);
+            at = dir[i].offset + sections[i].bytes;
+        }
+    };
+
+    memcpy(header.magic, PRECOMPUTED_MAGIC, sizeof(header.magic));
+    header.version = PRECOMPUTED_VERSION;
+    header.section_count = dir.size();
+    Checksum t;
+    t.add(dir.data(), dir.size() * sizeof(PrecomputedSection));
+    header.table_checksum = t.value();
+    Checksum c;
+    emit_body([&](const void* p, size_t n) { c.add(p, n); });
+    header.checksum = c.value();
+
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+    out.write((const char*)&header, sizeof(header));
+    emit_body([&](const void* p, size_t n) { out.write((const char*)p, n); });
+    return (bool)out;
+}
+
+PrecomputedFile::~PrecomputedFile()
+{
+    close();
+}
+
+void PrecomputedFile::close()
+{
+    if (base) munmap((void*)base, size);
+    base = nullptr;
+    size = 0;
+}
+
+bool PrecomputedFile::open(const string& path, string& error, bool verify_payload)
+{
+    close();
+    error.clear();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(PrecomputedHeader)) {
+        ::close(fd);
+        error = path + " is too small to be a precomputed file";
+        return false;
+    }
+    size_t len = st.st_size;
+    void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        error = "cannot map " + path;
+        return false;
+    }
+    base = (const unsigned char*)p;
+    size = len;
+
+    const PrecomputedHeader& h = header();
+    if (memcmp(h.magic, PRECOMPUTED_MAGIC, sizeof(h.magic)) != 0) {
+        error = path + " is not a precomputed file (old format? rerun ./precompute)";
+    } else if (h.version != PRECOMPUTED_VERSION) {
+        error = path + " has format version " + to_string(h.version) + ", expected "
+              + to_string(PRECOMPUTED_VERSION) + "; rerun ./precompute";
+    } else if (h.dtype != DTYPE_F32 || h.m < 0) {
+        error = path + " has an unsupported layout";
+    } else if (sizeof(PrecomputedHeader) + (uint64_t)h.section_count * sizeof(PrecomputedSection) > size) {
+        error = path + " is truncated";
+    } else {
+        const PrecomputedSection* dir = (const PrecomputedSection*)(base + sizeof(PrecomputedHeader));
+        Checksum t;
+        t.add(dir, h.section_count * sizeof(PrecomputedSection));
+        if (t.value() != h.table_checksum) error = path + " is corrupt (section table checksum mismatch)";
+        for (uint32_t i = 0; i < h.section_count && error.empty(); i++)
+            if (dir[i].offset % PRECOMPUTED_ALIGN != 0 || dir[i].offset > size || dir[i].bytes > size - dir[i].offset)
+                error = path + " is truncated";
+        if (error.empty() && verify_payload) {
+            Checksum c;
+            c.add(base + sizeof(PrecomputedHeader), size - sizeof(PrecomputedHeader));
+            if (c.value() != h.checksum) error = path + " is corrupt (checksum mismatch)";
+        }
+    }
+    if (!error.empty()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+const void* PrecomputedFile::section(uint32_t tag, size_t* bytes) const
+{
+    const PrecomputedSection* dir = (const PrecomputedSection*)(base + sizeof(PrecomputedHeader));
+    for (uint32_t i = 0; i < header().section_count; i++) {
+        if (dir[i].tag != tag) continue;
+        if (bytes) *bytes = dir[i].bytes;
+        return base + dir[i].offset;
+    }
+    return nullptr;
+}
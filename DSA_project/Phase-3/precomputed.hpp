@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// precomputed.bin layout (native byte order):
+//   PrecomputedHeader
+//   PrecomputedSection[section_count]
+//   section payloads, each starting on a 64-byte boundary
+// table_checksum covers the section table and is checked on every open;
+// together with the section bounds that rejects a truncated or half-written
+// file without reading the payloads. checksum covers every byte after the
+// header and is only checked when asked for, since that reads the whole
+// file (precompute checks the file it wrote).
+static const char PRECOMPUTED_MAGIC[8] = {'D', 'L', 'V', 'P', 'R', 'E', 'C', '\0'};
+static const uint32_t PRECOMPUTED_VERSION = 3;
+static const uint32_t PRECOMPUTED_ALIGN = 64;
+
+enum PrecomputedDtype : uint32_t {
+    DTYPE_F32 = 1,
+};
+
+enum PrecomputedTag : uint32_t {
+    SEC_IDS = 1,        // int32[m], important node ids in ascending order
+    SEC_DIST = 2,       // dtype[m * m], row-major travel times in seconds
+    SEC_RADIUS = 3,     // double[m], distance from the depot in lat/lon units
+    SEC_ANGLE = 4,      // double[m], bearing from the depot
+    // only when the graph has speed profiles, with c = SpeedClasses::count:
+    SEC_SLOWDOWN = 5,   // float[c * SPEED_SLOTS], SpeedClasses::slowdown
+    SEC_LEVEL = 6,      // float[m * m], mean time of each pair's path over its static time
+    SEC_SHARE = 7,      // uint8[m * m * c], share of that mean time on each class, in 1/255
+    // the hierarchy and search trees road paths are rebuilt from (ch.hpp):
+    SEC_CH_NODES = 8,   // int32[n], node id at each hierarchy position
+    SEC_UNPACK_UP = 9,  // UnpackArc[], per upward arc
+    SEC_UNPACK_DOWN = 10,   // UnpackArc[], per downward arc
+    SEC_TREE_FIRST = 11,    // int64[2m + 1], row i's forward tree is [first[i], first[i + 1]), its backward one at m + i
+    SEC_TREES = 12,     // TreeEntry[], parents counted from the tree's first entry
+    SEC_MEET = 13,      // int32[m * m * 2], MeetingPaths::meet
+};
+
+struct PrecomputedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dtype;
+    uint64_t graph_hash;        // graph_fingerprint() of the source graph
+    uint64_t nodes_hash;        // important_nodes_hash() of the query set
+    int32_t m;
+    uint32_t section_count;
+    uint64_t checksum;
+    uint64_t table_checksum;
+};
+
+struct PrecomputedSection {
+    uint32_t tag;
+    uint32_t reserved;
+    uint64_t offset;            // from the start of the file
+    uint64_t bytes;
+};
+
+// FNV-1a over 64-bit words; feeding a buffer in pieces gives the same
+// result as feeding it in one go.
+class Checksum {
+public:
+    void add(const void* data, size_t n);
+    uint64_t value() const;
+
+private:
+    uint64_t h = 1469598103934665603ULL;
+    uint64_t pending = 0;
+    int pending_bytes = 0;
+};
+
+// Hash of the depot/pickup/dropoff id set, given sorted and unique.
+uint64_t important_nodes_hash(const std::vector<int>& sorted_ids);
+
+// Collects sections (the caller keeps the data alive) and writes the file.
+class PrecomputedWriter {
+public:
+    void add(uint32_t tag, const void* data, size_t bytes);
+    bool write(const std::string& path, PrecomputedHeader header) const;
+
+private:
+    struct Pending { uint32_t tag; const void* data; size_t bytes; };
+    std::vector<Pending> sections;
+};
+
+// Read-only mmap of precomputed.bin; sections are used in place.
+class PrecomputedFile {
+public:
+    PrecomputedFile() = default;
+    PrecomputedFile(const PrecomputedFile&) = delete;
+    PrecomputedFile& operator=(const PrecomputedFile&) = delete;
+    ~PrecomputedFile();
+
+    // Maps and validates the file, the payloads too if verify_payload; on
+    // failure explains why in error.
+    bool open(const std::string& path, std::string& error, bool verify_payload = false);
+    void close();
+
+    const PrecomputedHeader& header() const { return *(const PrecomputedHeader*)base; }
+    const void* section(uint32_t tag, size_t* bytes = nullptr) const;
+
+private:
+    const unsigned char* base = nullptr;
+    size_t size = 0;
+};
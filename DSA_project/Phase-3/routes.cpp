@@ -0,0 +1,525 @@
+#include "routes.hpp"
+#include <algorithm>
+#include <climits>
+using namespace std;
+
+vector<int> stops_to_route(const vector<int>& stops, const ClusterStops& cs)
+{
+    vector<int> route;
+    for (int i = 0; i < (int)stops.size(); i++) {
+        int s = stops[i];
+        bool own_pickup_here = !ClusterStops::is_pickup(s) && s != 0
+                               && cs.node[ClusterStops::partner(s)] == cs.node[s];
+        if (!route.empty() && route.back() == cs.node[s] && !own_pickup_here) continue;
+        route.push_back(cs.node[s]);
+    }
+    return route;
+}
+
+bool stops_valid(const vector<int>& stops, const ClusterStops& cs)
+{
+    if ((int)stops.size() != cs.k || stops[0] != 0) return false;
+    vector<int> pos(cs.k, -1);
+    for (int i = 0; i < (int)stops.size(); i++) pos[stops[i]] = i;
+    for (int s = 1; s < cs.k; s += 2)
+        if (pos[s] < 0 || pos[s + 1] < pos[s]) return false;
+    if (!cs.constrained()) return true;
+    Segment all;
+    for (int s : stops) all = all.then(cs, Segment::of(cs, s));
+    return all.feasible(cs);
+}
+
+Segment Segment::of(const ClusterStops& cs, int s)
+{
+    Segment g;
+    g.first = g.last = s;
+    g.early = cs.open(s);
+    g.late = s == 0 ? 0.0 : cs.close(s);
+    g.load = g.peak = cs.demand(s);
+    return g;
+}
+
+Segment Segment::then(const ClusterStops& cs, const Segment& next) const
+{
+    if (first < 0) return next;
+    if (next.first < 0) return *this;
+    Segment g;
+    g.first = first;
+    g.last = next.last;
+    double delta = duration - warp + cs.leg(last, next.first);
+    double wait = max(next.early - delta - late, 0.0);
+    double over = max(early + delta - next.late, 0.0);
+    g.duration = duration + next.duration + cs.leg(last, next.first) + wait;
+    g.warp = warp + next.warp + over;
+    g.early = max(next.early - delta, early) - wait;
+    g.late = min(next.late - delta, late) + over;
+    g.load = load + next.load;
+    g.peak = max(peak, load + next.peak);
+    return g;
+}
+
+vector<int> greedy_route(const ClusterStops& cs) {
+    vector<int> stops = {0};
+    int n = (cs.k - 1) / 2;
+    vector<bool> picked_up(n, false);
+    vector<bool> delivered(n, false);
+    int current = 0;
+    int remaining = n * 2;
+    double now = 0.0;
+    int load = 0;
+
+    while (remaining > 0) {
+        double best = 1e18;
+        int best_stop = -1;
+
+        for (int i = 0; i < n; i++) {
+            int s = !picked_up[i] ? 2 * i + 1 : !delivered[i] ? 2 * i + 2 : -1;
+            if (s < 0) continue;
+            // time until s can be served, waiting included
+            double d = max(cs.at(current, s) * cs.scale(current, s, now), cs.open(s) - now);
+            if (now + d > cs.close(s)) continue;
+            if (cs.capacity > 0 && load + cs.demand(s) > cs.capacity) continue;
+            if (d < best) {
+                best = d;
+                best_stop = s;
+            }
+        }
+
+        if (best_stop == -1) break;
+
+        stops.push_back(best_stop);
+        now += best;
+        load += cs.demand(best_stop);
+        current = best_stop;
+        int i = (best_stop - 1) / 2;
+        if (ClusterStops::is_pickup(best_stop)) picked_up[i] = true;
+        else delivered[i] = true;
+        remaining--;
+    }
+
+    return stops;
+}
+
+void Route::refresh(const ClusterStops& cs)
+{
+    int L = s.size();
+    arrive.assign(L, 0.0);
+    ahead.assign(L + 1, 0);
+    for (int i = 1; i < L; i++) arrive[i] = arrive[i - 1] + cs.leg(s[i - 1], s[i]);
+    cost = 0.0;
+    for (int i = L - 1; i >= 1; i--) {
+        bool drop = !ClusterStops::is_pickup(s[i]);
+        ahead[i] = ahead[i + 1] + drop;
+        if (drop) cost += arrive[i];
+    }
+    ahead[0] = ahead[1];
+
+    if (cs.timed()) cost = route_latency(s, cs);
+    if (!cs.constrained()) return;
+    head.assign(L, Segment());
+    tail.assign(L + 1, Segment());
+    for (int i = 0; i < L; i++)
+        head[i] = (i ? head[i - 1] : Segment()).then(cs, Segment::of(cs, s[i]));
+    for (int i = L - 1; i >= 0; i--)
+        tail[i] = Segment::of(cs, s[i]).then(cs, tail[i + 1]);
+}
+
+// With the pickup after a and the dropoff after a later b, the delta splits
+// into a term in a alone and a term in b alone, so one pass keeps the best
+// a seen so far. Constraints break that: which a is allowed depends on b,
+// so every pair is tried, each checked by concatenating the segments
+// before a, the pickup, s[a+1..b] (grown one stop at a time), the dropoff
+// and the rest.
+Insertion best_insertion(const ClusterStops& cs, const Route& r, int order)
+{
+    const vector<int>& s = r.s;
+    int L = s.size();
+    int p = 2 * order + 1, d = p + 1;
+    Insertion best;
+
+    auto next_leg = [&](int b) { return b + 1 < L ? cs.leg(s[b], s[b + 1]) : 0.0; };
+    // pickup and dropoff back to back after b, nl being the leg they split
+    auto together = [&](int b, double nl) {
+        double to_p = cs.leg(s[b], p), p_to_d = cs.leg(p, d);
+        double delta = r.arrive[b] + to_p + p_to_d;
+        if (b + 1 < L) delta += (to_p + p_to_d + cs.leg(d, s[b + 1]) - nl) * r.ahead[b + 1];
+        return delta;
+    };
+    // pickup after a, before a dropoff further on
+    auto pickup_part = [&](int a, double nl) {
+        return (cs.leg(s[a], p) + cs.leg(p, s[a + 1]) - nl) * (r.ahead[a + 1] + 1);
+    };
+    // dropoff after b, with the pickup somewhere before
+    auto dropoff_part = [&](int b, double nl) {
+        double to_d = cs.leg(s[b], d);
+        double g = r.arrive[b] + to_d;
+        if (b + 1 < L) g += (to_d + cs.leg(d, s[b + 1]) - nl) * r.ahead[b + 1];
+        return g;
+    };
+
+    if (cs.constrained()) {
+        Segment P = Segment::of(cs, p), D = Segment::of(cs, d);
+        for (int a = 0; a < L; a++) {
+            Segment lead = r.head[a].then(cs, P);
+            if (!lead.feasible(cs)) continue;
+            double f = a + 1 < L ? pickup_part(a, next_leg(a)) : 0.0;
+            for (int b = a; b < L; b++) {
+                // adding stops never takes lateness or load back
+                if (b > a) lead = lead.then(cs, Segment::of(cs, s[b]));
+                if (!lead.feasible(cs)) break;
+                if (!lead.then(cs, D).then(cs, r.tail[b + 1]).feasible(cs)) continue;
+                double nl = next_leg(b);
+                double delta = b == a ? together(b, nl) : f + dropoff_part(b, nl);
+                if (delta < best.delta) best = {delta, a, b};
+            }
+        }
+        return best;
+    }
+
+    double best_f = 1e18;
+    int best_a = -1;
+    for (int b = 0; b < L; b++) {
+        double nl = next_leg(b);
+        double t = together(b, nl);
+        if (t < best.delta) best = {t, b, b};
+        if (best_a >= 0) {
+            double g = best_f + dropoff_part(b, nl);
+            if (g < best.delta) best = {g, best_a, b};
+        }
+        if (b + 1 < L) {
+            double f = pickup_part(b, nl);
+            if (f < best_f) {
+                best_f = f;
+                best_a = b;
+            }
+        }
+    }
+    return best;
+}
+
+// Local search on a stop sequence: 2-opt (segment reversal), or-opt
+// (move 2-3 consecutive stops) and relocate (move one stop). The objective
+// is the one compute_total_delivery_time scores, the sum of dropoff arrival
+// times. Every leg counts once per dropoff still ahead of it, so with
+// prefix arrival times, suffix dropoff counts and dropoff-weighted prefix
+// leg sums each move is an O(1) delta. Precedence is checked against the
+// partner positions. Stops whose neighbourhood gave nothing are left alone
+// (don't-look bits) until a move changes the route at or before them, since
+// that shifts every arrival after it; once the queue drains, a full sweep
+// repeats until no move is made. Under constraints each move
+// is checked by concatenating prefix, moved and suffix segments, the middle
+// one grown a stop at a time by the loops; waiting at windows and
+// time-dependent legs are outside the deltas, so with either a move is only
+// made if the true latency drops.
+namespace {
+
+class RouteSearch {
+public:
+    RouteSearch(vector<int>& stops, const ClusterStops& cs) : s(stops), cs(cs) {}
+
+    void run(const Deadline& deadline) {
+        int n = s.size();
+        if (n <= 2) return;
+        vector<char> active(cs.k, 1);
+        vector<int> queue(s.begin() + 1, s.end());
+        refresh();
+        double latency = cs.timed() ? route_latency(s, cs) : 0.0;
+        bool improved = false;
+
+        while (true) {
+            if (queue.empty()) {
+                if (!improved) return;
+                improved = false;
+                for (int i = 1; i < n; i++) {
+                    active[s[i]] = 1;
+                    queue.push_back(s[i]);
+                }
+            }
+            if (deadline.expired()) return;
+            int stop = queue.back(); queue.pop_back();
+            active[stop] = 0;
+
+            Move m = best_move(pos[stop]);
+            if (m.delta > -EPS) continue;
+
+            if (cs.timed()) {
+                vector<int> before = s;
+                apply(m);
+                double after = route_latency(s, cs);
+                if (after > latency - EPS) {
+                    s = move(before);
+                    continue;
+                }
+                latency = after;
+            } else {
+                apply(m);
+            }
+            refresh();
+            improved = true;
+            int from = max(1, (m.kind == MOVE ? min(m.a, m.c) : m.a) - 1);
+            for (int p = from; p < n; p++) {
+                if (active[s[p]]) continue;
+                active[s[p]] = 1;
+                queue.push_back(s[p]);
+            }
+        }
+    }
+
+private:
+    static constexpr double EPS = 1e-7;
+    static constexpr int MAX_SEGMENT = 3;
+
+    enum Kind { REVERSE, MOVE };
+    struct Move {
+        Kind kind = REVERSE;
+        int a = 0, b = 0, c = 0;       // reverse [a, b]; or move [a, b] after position c
+        double delta = 0.0;
+    };
+
+    vector<int>& s;
+    const ClusterStops& cs;
+    vector<int> pos;                    // stop -> position
+    vector<int> drop_at;                // position of a pickup -> its dropoff's position
+    vector<int> pick_at;                // position of a dropoff -> its pickup's position
+    vector<double> arrive;              // arrival time at position i
+    vector<double> bwd;                 // same prefix with every leg walked backwards
+    vector<int> ahead;                  // dropoffs at positions >= i (n + 1 entries)
+    vector<double> fwd_w, bwd_w;        // prefix legs weighted by the dropoffs ahead of them
+    vector<Segment> head, tail;         // s[0..i] and s[i..], only under constraints
+
+    double c(int a, int b) const { return cs.leg(a, b); }
+
+    void refresh() {
+        int n = s.size();
+        pos.assign(cs.k, -1);
+        for (int i = 0; i < n; i++) pos[s[i]] = i;
+        drop_at.assign(n, INT_MAX);
+        pick_at.assign(n, -1);
+        for (int i = 1; i < n; i++) {
+            int partner = pos[ClusterStops::partner(s[i])];
+            if (ClusterStops::is_pickup(s[i])) drop_at[i] = partner;
+            else pick_at[i] = partner;
+        }
+        ahead.assign(n + 1, 0);
+        for (int i = n - 1; i >= 1; i--)
+            ahead[i] = ahead[i + 1] + (pick_at[i] >= 0);
+        ahead[0] = ahead[1];
+        arrive.assign(n, 0.0);
+        bwd.assign(n, 0.0);
+        fwd_w.assign(n, 0.0);
+        bwd_w.assign(n, 0.0);
+        for (int i = 1; i < n; i++) {
+            double f = c(s[i - 1], s[i]), r = c(s[i], s[i - 1]);
+            arrive[i] = arrive[i - 1] + f;
+            bwd[i] = bwd[i - 1] + r;
+            fwd_w[i] = fwd_w[i - 1] + f * ahead[i];
+            bwd_w[i] = bwd_w[i - 1] + r * ahead[i];
+        }
+        if (!cs.constrained()) return;
+        head.assign(n, Segment());
+        tail.assign(n + 1, Segment());
+        for (int i = 0; i < n; i++)
+            head[i] = (i ? head[i - 1] : Segment()).then(cs, Segment::of(cs, s[i]));
+        for (int i = n - 1; i >= 0; i--)
+            tail[i] = Segment::of(cs, s[i]).then(cs, tail[i + 1]);
+    }
+
+    bool fits(const Segment& a, const Segment& b, const Segment& c) const {
+        return a.then(cs, b).then(cs, c).feasible(cs);
+    }
+
+    // Reversing [i, j]: the boundary legs keep their weights; inside, the
+    // leg that used to end at t + 1 is now followed by everything after the
+    // segment plus the segment's stops before t + 1.
+    double reverse_delta(int i, int j) const {
+        int n = s.size();
+        double tail = j + 1 < n ? (c(s[i], s[j + 1]) - c(s[j], s[j + 1])) * ahead[j + 1] : 0.0;
+        double before = fwd_w[j] - fwd_w[i];
+        double after = (ahead[j + 1] + ahead[i]) * (bwd[j] - bwd[i]) - (bwd_w[j] - bwd_w[i]);
+        return (c(s[i - 1], s[j]) - c(s[i - 1], s[i])) * ahead[i] + after - before + tail;
+    }
+
+    // Moving [i, e] to sit after position g: everything that moves is shifted
+    // by a constant, so the delta is three shifts times their dropoff counts.
+    double move_delta(int i, int e, int g) const {
+        int n = s.size();
+        int seg = ahead[i] - ahead[e + 1];
+        if (g > e) {
+            double gap = arrive[i - 1] + c(s[i - 1], s[e + 1]) - arrive[e + 1];
+            double moved = arrive[g] + gap + c(s[g], s[i]) - arrive[i];
+            double rest = g + 1 < n ? arrive[e] + moved + c(s[e], s[g + 1]) - arrive[g + 1] : 0.0;
+            return gap * (ahead[e + 1] - ahead[g + 1]) + moved * seg + rest * ahead[g + 1];
+        }
+        double moved = arrive[g] + c(s[g], s[i]) - arrive[i];
+        double pushed = arrive[e] + moved + c(s[e], s[g + 1]) - arrive[g + 1];
+        double rest = e + 1 < n ? arrive[i - 1] + pushed + c(s[i - 1], s[e + 1]) - arrive[e + 1] : 0.0;
+        return moved * seg + pushed * (ahead[g + 1] - ahead[i]) + rest * ahead[e + 1];
+    }
+
+    Move best_move(int i) const {
+        int n = s.size();
+        bool checked = cs.constrained();
+        Move best;
+
+        // 2-opt with i as the left end; a reversal is feasible while no
+        // pickup inside it has its dropoff inside it too
+        int first_drop = INT_MAX;
+        Segment flipped;
+        for (int j = i; j < n; j++) {
+            first_drop = min(first_drop, drop_at[j]);
+            if (first_drop <= j) break;
+            if (checked) flipped = Segment::of(cs, s[j]).then(cs, flipped);
+            if (j == i) continue;
+            double d = reverse_delta(i, j);
+            if (d < best.delta && (!checked || fits(head[i - 1], flipped, tail[j + 1])))
+                best = {REVERSE, i, j, 0, d};
+        }
+        // ... and as the right end
+        int last_pick = -1;
+        flipped = Segment();
+        for (int h = i; h >= 1; h--) {
+            last_pick = max(last_pick, pick_at[h]);
+            if (last_pick >= h) break;
+            if (checked) flipped = flipped.then(cs, Segment::of(cs, s[h]));
+            if (h == i) continue;
+            double d = reverse_delta(h, i);
+            if (d < best.delta && (!checked || fits(head[h - 1], flipped, tail[i + 1])))
+                best = {REVERSE, h, i, 0, d};
+        }
+
+        // relocate / or-opt: move s[i..e] between s[g] and s[g+1]
+        Segment moving;
+        for (int e = i; e < min(n, i + MAX_SEGMENT); e++) {
+            int limit = n - 1;          // last g allowed going forward
+            int floor = 0;              // first g allowed going backward
+            for (int p = i; p <= e; p++) {
+                if (drop_at[p] != INT_MAX && drop_at[p] > e) limit = min(limit, drop_at[p] - 1);
+                if (pick_at[p] >= 0 && pick_at[p] < i) floor = max(floor, pick_at[p]);
+            }
+            if (checked) moving = moving.then(cs, Segment::of(cs, s[e]));
+            Segment skipped;            // the stops the segment jumps over
+            for (int g = e + 1; g <= limit; g++) {
+                if (checked) skipped = skipped.then(cs, Segment::of(cs, s[g]));
+                double d = move_delta(i, e, g);
+                if (d < best.delta
+                    && (!checked || fits(head[i - 1].then(cs, skipped), moving, tail[g + 1])))
+                    best = {MOVE, i, e, g, d};
+            }
+            skipped = Segment();
+            for (int g = i - 2; g >= floor; g--) {
+                if (checked) skipped = Segment::of(cs, s[g + 1]).then(cs, skipped);
+                double d = move_delta(i, e, g);
+                if (d < best.delta
+                    && (!checked || fits(head[g].then(cs, moving), skipped, tail[e + 1])))
+                    best = {MOVE, i, e, g, d};
+            }
+        }
+        return best;
+    }
+
+    void apply(const Move& m) {
+        auto it = s.begin();
+        if (m.kind == REVERSE) reverse(it + m.a, it + m.b + 1);
+        else if (m.c > m.b) rotate(it + m.a, it + m.b + 1, it + m.c + 1);
+        else rotate(it + m.c + 1, it + m.a, it + m.b + 1);
+    }
+};
+
+} // namespace
+
+void improve_route(vector<int>& stops, const ClusterStops& cs, const Deadline& deadline)
+{
+    RouteSearch(stops, cs).run(deadline);
+}
+
+double route_latency(const vector<int>& stops, const ClusterStops& cs)
+{
+    double t = 0.0, total = 0.0;
+    for (int i = 1; i < (int)stops.size(); i++) {
+        t = max(t + cs.leg_at(stops[i - 1], stops[i], t), cs.open(stops[i]));
+        if (!ClusterStops::is_pickup(stops[i])) total += t;
+    }
+    return total;
+}
+
+vector<int> exact_route(const ClusterStops& cs)
+{
+    // Each order is waiting (0), on board (1) or delivered (2), so the
+    // precedence-feasible visited sets are exactly the base-3 numbers below
+    // 3^m; adding a stop only ever raises the number, which makes plain
+    // ascending order a valid DP order. Rows are padded to EXACT_LANES so
+    // the min over the previous stop runs lane-wise.
+    const int L = EXACT_LANES;
+    const float NONE = 1e30f;
+    int m = cs.orders(), k = cs.k;
+    int width = (k + L - 1) / L * L;
+    vector<int> pow3(m + 1, 1);
+    for (int j = 1; j <= m; j++) pow3[j] = pow3[j - 1] * 3;
+    int states = pow3[m];
+
+    // into[b][a] = leg a -> b, so the inner loop reads both rows contiguously
+    vector<float> into((size_t)k * width, NONE);
+    for (int b = 0; b < k; b++)
+        for (int a = 0; a < k; a++)
+            if (a != b) into[(size_t)b * width + a] = cs.leg(a, b);
+
+    // best[state][last] = least latency of a path from the depot covering
+    // state and ending at last; each leg is paid once per order not yet
+    // delivered when it starts
+    vector<float> best((size_t)states * width, NONE);
+    best[0] = 0.0f;
+    vector<int> digit(m);
+    auto step = [&](int prev, int stop, int waiting, float* lanes) {
+        const float* from = &best[(size_t)prev * width];
+        const float* col = &into[(size_t)stop * width];
+        float w = waiting;
+        for (int l = 0; l < L; l++) lanes[l] = NONE;
+        for (int a = 0; a < width; a += L)
+            for (int l = 0; l < L; l++) {
+                float c = from[a + l] + w * col[a + l];
+                lanes[l] = c < lanes[l] ? c : lanes[l];
+            }
+    };
+    for (int state = 1; state < states; state++) {
+        int delivered = 0, on_board = 0;
+        for (int j = 0, x = state; j < m; j++, x /= 3) {
+            digit[j] = x % 3;
+            delivered += digit[j] == 2;
+            if (digit[j] == 1) on_board += cs.demand(2 * j + 1);
+        }
+        if (cs.capacity > 0 && on_board > cs.capacity) continue;
+        for (int j = 0; j < m; j++) {
+            if (digit[j] == 0) continue;
+            int stop = digit[j] == 1 ? 2 * j + 1 : 2 * j + 2;
+            int waiting = m - delivered + (digit[j] == 2);
+            float lanes[EXACT_LANES];
+            step(state - pow3[j], stop, waiting, lanes);
+            best[(size_t)state * width + stop] = *min_element(lanes, lanes + L);
+        }
+    }
+
+    // walk back from the cheapest final stop
+    int state = states - 1, last = 0;
+    for (int s = 1; s < k; s++)
+        if (best[(size_t)state * width + s] < best[(size_t)state * width + last]) last = s;
+    if (best[(size_t)state * width + last] >= NONE) return {0};
+    vector<int> stops;
+    while (state != 0) {
+        stops.push_back(last);
+        int j = ClusterStops::order_of(last);
+        int prev = state - pow3[j];
+        int delivered = 0;
+        for (int i = 0, x = state; i < m; i++, x /= 3) delivered += x % 3 == 2;
+        int waiting = m - delivered + !ClusterStops::is_pickup(last);
+        const float* from = &best[(size_t)prev * width];
+        const float* col = &into[(size_t)last * width];
+        int arg = 0;
+        for (int a = 1; a < k; a++)
+            if (from[a] + waiting * col[a] < from[arg] + waiting * col[arg]) arg = a;
+        state = prev;
+        last = arg;
+    }
+    stops.push_back(0);
+    reverse(stops.begin(), stops.end());
+    return stops;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include "deadline.hpp"
+#include "graph.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Stops of a routing problem: stop 0 is the depot, order i has its pickup
+// at stop 2i+1 and its dropoff at 2i+2. Route heuristics work on stop
+// indices and read travel times from the k x k submatrix instead of going
+// through the id lookup for every pair.
+struct ClusterStops {
+    // unreachable legs get a large finite cost in searches so that sums of
+    // legs stay exact
+    static constexpr double UNREACHABLE = 1e9;
+
+    int k = 0;
+    std::vector<int> node;
+    std::vector<float> cost;        // row-major, 1e18 when unreachable
+
+    double at(int a, int b) const {
+        float d = cost[(size_t)a * k + b];
+        return d >= 1e17f ? 1e18 : d;
+    }
+    double leg(int a, int b) const { return std::min(at(a, b), UNREACHABLE); }
+
+    // Optional constraints. load is +q at a pickup and -q at its dropoff
+    // (1 each when empty); earliest/latest are per-stop service windows,
+    // left empty when no order has one. Arriving early means waiting.
+    int capacity = 0;               // most load on board at once, 0: unlimited
+    std::vector<int> load;
+    std::vector<double> earliest, latest;
+
+    bool has_windows() const { return !earliest.empty(); }
+    bool constrained() const { return capacity > 0 || has_windows(); }
+    double open(int s) const { return has_windows() ? earliest[s] : 0.0; }
+    double close(int s) const { return has_windows() ? latest[s] : 1e18; }
+    int demand(int s) const { return !load.empty() ? load[s] : s == 0 ? 0 : is_pickup(s) ? 1 : -1; }
+
+    // Optional time-dependent legs (SpeedClasses): with classes > 0 a leg
+    // leaving t seconds after departure takes its mean time (level times
+    // the static one) with each class's part, share in 1/255, scaled by
+    // that class's slowdown in the slot. Segments and windows stay on the
+    // static times.
+    int classes = 0;
+    std::vector<float> level;       // k x k
+    std::vector<uint8_t> share;     // k x k x classes
+    std::vector<float> slowdown;    // classes x SPEED_SLOTS
+    double departure = 0.0;         // time of day at t = 0, in seconds
+
+    bool time_dependent() const { return classes > 0; }
+    // route_latency is more than the sum of the legs' static costs
+    bool timed() const { return has_windows() || time_dependent(); }
+    double scale(int a, int b, double t) const {
+        if (!time_dependent()) return 1.0;
+        int slot = (long long)std::floor((departure + t) / SLOT_SECONDS) % SPEED_SLOTS;
+        size_t pair = (size_t)a * k + b;
+        const uint8_t* f = &share[pair * classes];
+        double x = 0.0;
+        for (int c = 0; c < classes; c++) x += f[c] * slowdown[(size_t)c * SPEED_SLOTS + slot];
+        return level[pair] * (1.0 + x / 255.0);
+    }
+    double leg_at(int a, int b, double t) const {
+        double d = leg(a, b);
+        return d < UNREACHABLE ? d * scale(a, b, t) : d;
+    }
+
+    int orders() const { return (k - 1) / 2; }
+    static bool is_pickup(int s) { return s % 2 == 1; }
+    static int partner(int s) { return is_pickup(s) ? s + 1 : s - 1; }
+    static int order_of(int s) { return (s - 1) / 2; }
+};
+
+// What feasibility needs to know about a run of consecutive stops, so that
+// checking a rearranged route is a few O(1) concatenations of pieces of the
+// old one (the time-window segments of Vidal et al., without penalties):
+// time from serving the first stop to serving the last including waits,
+// the lateness that cannot be avoided (warp), the window for starting at
+// the first stop, and the net and peak load change.
+struct Segment {
+    int first = -1, last = -1;      // first < 0: the empty segment
+    double duration = 0.0, warp = 0.0;
+    double early = 0.0, late = 1e18;
+    int load = 0, peak = 0;
+
+    static Segment of(const ClusterStops& cs, int s);
+    Segment then(const ClusterStops& cs, const Segment& next) const;
+    bool feasible(const ClusterStops& cs) const {
+        return warp <= 0.0 && (cs.capacity <= 0 || peak <= cs.capacity);
+    }
+};
+
+// Node route for a stop sequence. A stop at the same node as the previous
+// one is merged into it, except a dropoff right after its own pickup, which
+// has to show up as a separate visit.
+std::vector<int> stops_to_route(const std::vector<int>& stops, const ClusterStops& cs);
+
+// True if stops visits every stop once, starts at the depot, has each
+// pickup before its dropoff and keeps to the windows and capacity.
+bool stops_valid(const std::vector<int>& stops, const ClusterStops& cs);
+
+// Nearest-neighbour construction over all orders; stops short if the rest
+// is unreachable or would break a window or the capacity.
+std::vector<int> greedy_route(const ClusterStops& cs);
+
+// Sum of dropoff service times along stops (arrival, or the window opening
+// if that is later), with unreachable legs capped and time-dependent legs
+// priced at their departure.
+double route_latency(const std::vector<int>& stops, const ClusterStops& cs);
+
+// Orders up to which exact_route is practical: 3^m * (2m + 1) states.
+constexpr int EXACT_MAX_ORDERS = 12;
+constexpr int EXACT_LANES = 8;
+
+// Route with the least route_latency over all orders, by dynamic
+// programming over (orders waiting / on board / delivered, last stop).
+// Needs cs.orders() <= EXACT_MAX_ORDERS and no windows, and prices legs
+// statically; states over the
+// capacity are skipped. Returns just the depot if no route fits.
+std::vector<int> exact_route(const ClusterStops& cs);
+
+// A stop sequence with what insertion deltas need: arrival time at every
+// position and the number of dropoffs from each position on. Under
+// constraints it also keeps the segments of every prefix and suffix.
+struct Route {
+    std::vector<int> s;
+    std::vector<double> arrive;     // without waiting
+    std::vector<int> ahead;         // dropoffs at positions >= i, size() + 1 entries
+    std::vector<Segment> head, tail;    // s[0..i] and s[i..], only if cs.constrained()
+    double cost = 0.0;              // route_latency(s)
+
+    void refresh(const ClusterStops& cs);
+};
+
+struct Insertion {
+    double delta = 1e18;
+    int a = -1, b = -1;             // pickup goes after position a, dropoff after b (b >= a)
+};
+
+// Cheapest place for an order in r: O(route), or O(route^2) with O(1)
+// checks per pair under constraints. delta stays 1e18 if nothing fits.
+// Waiting and time-dependent legs are not priced in.
+Insertion best_insertion(const ClusterStops& cs, const Route& r, int order);
+
+// Local search minimising route_latency. stops may hold any subset of
+// orders as long as each pickup comes with its dropoff; moves that would
+// break a window or the capacity are skipped. With windows or
+// time-dependent legs a move is only kept if route_latency drops.
+void improve_route(std::vector<int>& stops, const ClusterStops& cs,
+                   const Deadline& deadline = Deadline::never());
@@ -0,0 +1,279 @@
+#include "stream.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+using namespace std;
+
+Dispatcher::Dispatcher(int drivers, int depot, int expected_orders, int capacity, Listener on_update)
+    : on_update(move(on_update))
+{
+    cs.k = 1;
+    cs.node = {depot};
+    cs.cost = {0.0f};
+    cs.capacity = capacity;
+    if (capacity > 0) cs.load = {0};
+    row = {precomputed_row(depot)};
+    reserve_stops(2 * max(expected_orders, 256) + 1);
+    routes.resize(drivers);
+    for (auto& r : routes) {
+        r.s = {0};
+        r.refresh(cs);
+    }
+    version.assign(drivers, 0);
+    queued.assign(drivers, 0);
+}
+
+Dispatcher::~Dispatcher()
+{
+    stop_repair();
+}
+
+// Grows the matrix geometrically so that an insert only copies it once in
+// a while; the used block keeps its entries.
+void Dispatcher::reserve_stops(int k)
+{
+    if (k <= cs.k) return;
+    int grown = max(k, 2 * cs.k);
+    vector<float> cost((size_t)grown * grown, 1e18f);
+    for (int a = 0; a < used; a++)
+        copy_n(&cs.cost[(size_t)a * cs.k], used, &cost[(size_t)a * grown]);
+    cs.cost.swap(cost);
+    cs.node.resize(grown, cs.node[0]);
+    row.resize(grown, row[0]);
+    if (!cs.load.empty()) cs.load.resize(grown, 0);
+    if (cs.has_windows()) {
+        cs.earliest.resize(grown, 0.0);
+        cs.latest.resize(grown, 1e18);
+    }
+    cs.k = grown;
+}
+
+DriverAssignment Dispatcher::assignment_of(int d) const
+{
+    DriverAssignment a;
+    a.driver_id = d;
+    a.route = stops_to_route(routes[d].s, cs);
+    for (int s : routes[d].s)
+        if (s != 0 && ClusterStops::is_pickup(s))
+            a.order_ids.push_back(order_list[ClusterStops::order_of(s)].order_id);
+    return a;
+}
+
+// Travel times between a stop's row and the new pickup and dropoff rows:
+// from the pickup, from the dropoff, to the pickup, to the dropoff.
+static array<float, 4> legs(int ra, int rp, int rd)
+{
+    return {ra == rp ? 0.0f : row_distance(rp, ra), ra == rd ? 0.0f : row_distance(rd, ra),
+            ra == rp ? 0.0f : row_distance(ra, rp), ra == rd ? 0.0f : row_distance(ra, rd)};
+}
+
+int Dispatcher::insert(const Order& o, string& error, double* elapsed_us)
+{
+    auto start = chrono::steady_clock::now();
+    int rp = precomputed_row(o.pickup), rd = precomputed_row(o.dropoff);
+    if (rp < 0 || rd < 0) {
+        error = "node not in the graph";
+        return -1;
+    }
+    // Legs of a node outside precomputed.bin are fallback searches, so they
+    // are looked up for the stops placed so far before taking the lock;
+    // stops another insert places meanwhile are looked up under it.
+    vector<int> known;
+    {
+        lock_guard<mutex> guard(lock);
+        known.assign(row.begin(), row.begin() + used);
+    }
+    vector<array<float, 4>> known_legs(known.size());
+    for (size_t a = 0; a < known.size(); a++) known_legs[a] = legs(known[a], rp, rd);
+    array<float, 4> at_p = legs(rp, rp, rd), at_d = legs(rd, rp, rd);
+
+    lock_guard<mutex> guard(lock);
+    if (order_ids.count(o.order_id)) {
+        error = "duplicate order_id";
+        return -1;
+    }
+
+    int order = order_list.size();
+    int p = 2 * order + 1, d = p + 1;
+    reserve_stops(d + 1);
+    if (o.has_windows() && !cs.has_windows()) {
+        // the first order with a window switches every route to checked
+        // insertions
+        cs.earliest.assign(cs.k, 0.0);
+        cs.latest.assign(cs.k, 1e18);
+        cs.latest[0] = 0.0;
+        for (auto& r : routes) r.refresh(cs);
+    }
+    order_list.push_back(o);
+    cs.node[p] = o.pickup;
+    cs.node[d] = o.dropoff;
+    if (!cs.load.empty()) {
+        cs.load[p] = o.load;
+        cs.load[d] = -o.load;
+    }
+    if (cs.has_windows()) {
+        cs.earliest[p] = o.pickup_open;
+        cs.latest[p] = o.pickup_close;
+        cs.earliest[d] = o.dropoff_open;
+        cs.latest[d] = o.dropoff_close;
+    }
+    row[p] = rp;
+    row[d] = rd;
+    used = d + 1;
+    // rows of the table are contiguous, so the new stops' own rows are
+    // cheap; the columns cost one cache line per stop
+    float* from_p = &cs.cost[(size_t)p * cs.k];
+    float* from_d = &cs.cost[(size_t)d * cs.k];
+    for (int a = 0; a < used; a++) {
+        array<float, 4> l = a == p ? at_p : a == d ? at_d
+                          : a < (int)known.size() ? known_legs[a] : legs(row[a], rp, rd);
+        from_p[a] = l[0];
+        from_d[a] = l[1];
+        float* to = &cs.cost[(size_t)a * cs.k];
+        to[p] = l[2];
+        to[d] = l[3];
+    }
+
+    // capped legs would let an unreachable order in at a huge delta
+    if (cs.at(0, p) >= 1e17 || cs.at(p, d) >= 1e17) {
+        order_list.pop_back();
+        used = p;
+        error = "no path between its stops";
+        return -1;
+    }
+    int driver = 0;
+    Insertion best;
+    for (int r = 0; r < (int)routes.size(); r++) {
+        Insertion ins = best_insertion(cs, routes[r], order);
+        if (ins.delta < best.delta) {
+            best = ins;
+            driver = r;
+        }
+    }
+    if (best.a < 0 || best.delta >= ClusterStops::UNREACHABLE) {
+        order_list.pop_back();
+        used = p;
+        error = "no route can take it within the windows and capacity";
+        return -1;
+    }
+    auto& s = routes[driver].s;
+    s.insert(s.begin() + best.b + 1, d);
+    s.insert(s.begin() + best.a + 1, p);
+    routes[driver].refresh(cs);
+    order_ids.insert(o.order_id);
+    version[driver]++;
+    if (!queued[driver]) {
+        queued[driver] = 1;
+        dirty.push_back(driver);
+        wake.notify_one();
+    }
+    if (elapsed_us)
+        *elapsed_us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    on_update(assignment_of(driver), o.order_id);
+    return driver;
+}
+
+void Dispatcher::start_repair(double slice_ms)
+{
+    lock_guard<mutex> guard(lock);
+    if (running) return;
+    running = true;
+    worker = thread([this, slice_ms] { repair_loop(slice_ms); });
+}
+
+void Dispatcher::stop_repair()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void Dispatcher::repair_loop(double slice_ms)
+{
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] { return !running || !dirty.empty(); });
+        if (!running) return;
+        int d = dirty.front();
+        dirty.pop_front();
+        queued[d] = 0;
+        long seen = version[d];
+        double before = routes[d].cost;
+
+        // Private copy with the route's orders renumbered 0..n-1, so the
+        // search neither races with inserts nor walks the whole matrix.
+        const vector<int>& s = routes[d].s;
+        ClusterStops local;
+        local.k = s.size();
+        vector<int> global(local.k, 0), stops = {0}, local_order(order_list.size(), -1);
+        int next = 0;
+        for (int i = 1; i < local.k; i++) {
+            int o = ClusterStops::order_of(s[i]);
+            if (ClusterStops::is_pickup(s[i])) local_order[o] = next++;
+            int stop = 2 * local_order[o] + (ClusterStops::is_pickup(s[i]) ? 1 : 2);
+            global[stop] = s[i];
+            stops.push_back(stop);
+        }
+        local.node.resize(local.k);
+        local.cost.resize((size_t)local.k * local.k);
+        local.capacity = cs.capacity;
+        if (!cs.load.empty()) local.load.resize(local.k);
+        if (cs.has_windows()) {
+            local.earliest.resize(local.k);
+            local.latest.resize(local.k);
+        }
+        for (int a = 0; a < local.k; a++) {
+            local.node[a] = cs.node[global[a]];
+            if (!cs.load.empty()) local.load[a] = cs.load[global[a]];
+            if (cs.has_windows()) {
+                local.earliest[a] = cs.earliest[global[a]];
+                local.latest[a] = cs.latest[global[a]];
+            }
+            for (int b = 0; b < local.k; b++)
+                local.cost[(size_t)a * local.k + b] = cs.cost[(size_t)global[a] * cs.k + global[b]];
+        }
+
+        guard.unlock();
+        Deadline slice(slice_ms);
+        improve_route(stops, local, slice);
+        double after = route_latency(stops, local);
+        bool unfinished = slice.expired_now();
+        guard.lock();
+
+        // a newer insert has queued the route again already
+        if (version[d] != seen || after >= before - 1e-7) continue;
+        for (auto& stop : stops) stop = global[stop];
+        routes[d].s = stops;
+        routes[d].refresh(cs);
+        version[d]++;
+        repaired++;
+        if (unfinished && !queued[d]) {
+            queued[d] = 1;
+            dirty.push_back(d);
+        }
+        on_update(assignment_of(d), -1);
+    }
+}
+
+vector<DriverAssignment> Dispatcher::assignments() const
+{
+    lock_guard<mutex> guard(lock);
+    vector<DriverAssignment> out;
+    for (int d = 0; d < (int)routes.size(); d++) out.push_back(assignment_of(d));
+    return out;
+}
+
+vector<Order> Dispatcher::orders() const
+{
+    lock_guard<mutex> guard(lock);
+    return order_list;
+}
+
+long Dispatcher::repairs() const
+{
+    lock_guard<mutex> guard(lock);
+    return repaired;
+}
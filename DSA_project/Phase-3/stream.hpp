@@ -0,0 +1,67 @@
+#pragma once
+#include "delivery.hpp"
+#include "routes.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+// Online dispatcher for stream mode: orders arrive one at a time and go to
+// the cheapest insertion over all drivers' routes. A background thread
+// runs improve_route on routes that changed, on a private copy of the
+// route so inserts never wait for it; a repair is dropped if the route was
+// changed again in the meantime. Updates go to the listener while the
+// dispatcher is locked, so they come out in the order they happened;
+// order_id is -1 for repairs.
+class Dispatcher {
+public:
+    using Listener = std::function<void(const DriverAssignment& updated, int order_id)>;
+
+    // expected_orders sizes the travel-time matrix up front; it doubles
+    // when exceeded, which costs one slow insert. capacity 0 is unlimited.
+    Dispatcher(int drivers, int depot, int expected_orders, int capacity, Listener on_update);
+    ~Dispatcher();
+    Dispatcher(const Dispatcher&) = delete;
+    Dispatcher& operator=(const Dispatcher&) = delete;
+
+    // Inserts o and reports the changed route. Returns the driver, or -1
+    // with the reason in error if o cannot be placed, cannot be reached or
+    // reuses an order_id. elapsed_us gets the time spent placing it, not
+    // counting the listener.
+    int insert(const Order& o, std::string& error, double* elapsed_us = nullptr);
+
+    // Each repair runs for at most slice_ms; a route that was still
+    // improving when time ran out is queued again.
+    void start_repair(double slice_ms);
+    void stop_repair();
+
+    std::vector<DriverAssignment> assignments() const;
+    std::vector<Order> orders() const;
+    long repairs() const;
+
+private:
+    Listener on_update;
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    ClusterStops cs;                // k is the capacity; stops past used are unset
+    std::vector<int> row;           // precomputed.bin row of each stop
+    int used = 1;
+    std::vector<Order> order_list;  // order i has stops 2i+1, 2i+2
+    std::unordered_set<int> order_ids;
+    std::vector<Route> routes;
+    std::vector<long> version;      // bumped on every change to a route
+    std::deque<int> dirty;          // drivers waiting for a repair
+    std::vector<char> queued;
+    long repaired = 0;
+
+    std::thread worker;
+    bool running = false;
+
+    void reserve_stops(int k);
+    DriverAssignment assignment_of(int d) const;
+    void repair_loop(double slice_ms);
+};